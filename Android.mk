@@ -21,11 +21,20 @@ LOCAL_SRC_FILES := \
 	src/hev-memory-allocator.c \
 	src/hev-memory-allocator-slice.c \
 	src/hev-task.c \
+	src/hev-task-clock.c \
+	src/hev-task-fd-watcher.c \
+	src/hev-task-io.c \
+	src/hev-task-io-uring.c \
 	src/hev-task-poll.c \
+	src/hev-task-sched-fair.c \
+	src/hev-task-sched-priority.c \
+	src/hev-task-stack.c \
+	src/hev-task-context.S \
 	src/hev-task-execute.S \
 	src/hev-task-executer.c \
 	src/hev-task-system.c \
 	src/hev-task-system-schedule.c \
+	src/hev-task-timer.c \
 	src/hev-task-timer-manager.c
 include $(LOCAL_PATH)/configs.mk
 LOCAL_CFLAGS += $(CONFIG_CFLAGS)
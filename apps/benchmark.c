@@ -0,0 +1,141 @@
+/*
+ ============================================================================
+ Name        : benchmark.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description :
+ ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <hev-task.h>
+#include <hev-task-system.h>
+
+static unsigned int task_count = 4096;
+static unsigned int round_count = 1000;
+static HevTask **tasks;
+
+static double
+get_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void
+shuffle_tasks (void)
+{
+	unsigned int i, seed = 1;
+
+	/* run queue order must not follow memory order, or prefetcher
+	 * hides the cache misses of a real workload */
+	for (i=task_count - 1; i>0; i--) {
+		unsigned int j;
+		HevTask *task;
+
+		seed = seed * 1103515245 + 12345;
+		j = (seed >> 8) % (i + 1);
+		task = tasks[i];
+		tasks[i] = tasks[j];
+		tasks[j] = task;
+	}
+}
+
+static void
+task_yield_entry (void *data)
+{
+	unsigned int i;
+
+	for (i=0; i<round_count; i++)
+		hev_task_yield (HEV_TASK_YIELD);
+}
+
+static void
+task_wait_entry (void *data)
+{
+	unsigned int i;
+
+	/* parked until woken up by waker */
+	for (i=0; i<round_count; i++)
+		hev_task_yield (HEV_TASK_WAITIO);
+}
+
+static void
+task_waker_entry (void *data)
+{
+	unsigned int i, j;
+
+	for (i=0; i<round_count; i++) {
+		for (j=0; j<task_count; j++)
+			hev_task_wakeup (tasks[j]);
+		/* run all woken up tasks */
+		hev_task_yield (HEV_TASK_YIELD);
+	}
+}
+
+int
+main (int argc, char *argv[])
+{
+	HevTask *task;
+	unsigned int i;
+	double begin, total;
+
+	if (argc > 1)
+		task_count = strtoul (argv[1], NULL, 10);
+	if (argc > 2)
+		round_count = strtoul (argv[2], NULL, 10);
+
+	tasks = malloc (sizeof (HevTask *) * task_count);
+	if (!tasks)
+		return -1;
+
+	hev_task_system_init ();
+
+	/* switch: all tasks runnable, yield in turn */
+	for (i=0; i<task_count; i++)
+		tasks[i] = hev_task_new (-1);
+	shuffle_tasks ();
+	for (i=0; i<task_count; i++)
+		hev_task_run (tasks[i], task_yield_entry, NULL);
+
+	begin = get_time ();
+	hev_task_system_run ();
+	total = get_time () - begin;
+
+	printf ("switch: %u tasks, %.1f ns/switch\n", task_count,
+				total / ((double) task_count * round_count));
+
+	/* wakeup: wake up all parked tasks, then run each of them once */
+	for (i=0; i<task_count; i++)
+		tasks[i] = hev_task_new (-1);
+	shuffle_tasks ();
+	for (i=0; i<task_count; i++) {
+		hev_task_set_priority (tasks[i], HEV_TASK_PRIORITY_HIGH);
+		hev_task_run (tasks[i], task_wait_entry, NULL);
+	}
+	shuffle_tasks ();
+
+	task = hev_task_new (-1);
+	hev_task_set_priority (task, HEV_TASK_PRIORITY_LOW);
+	hev_task_run (task, task_waker_entry, NULL);
+
+	begin = get_time ();
+	hev_task_system_run ();
+	total = get_time () - begin;
+
+	printf ("wakeup: %u tasks, %.1f ns/wakeup+switch\n", task_count,
+				total / ((double) task_count * round_count));
+
+	hev_task_system_fini ();
+
+	free (tasks);
+
+	return 0;
+}
+
@@ -8,6 +8,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <unistd.h>
 #include <string.h>
@@ -17,53 +18,9 @@
 #include <arpa/inet.h>
 
 #include <hev-task.h>
+#include <hev-task-io.h>
 #include <hev-task-system.h>
 
-static int
-task_socket_accept (int fd, struct sockaddr *restrict addr,
-			socklen_t *restrict addr_len)
-{
-	int new_fd;
-retry:
-	new_fd = accept (fd, addr, addr_len);
-	if (new_fd == -1 && errno == EAGAIN) {
-		hev_task_yield (HEV_TASK_WAITIO);
-		goto retry;
-	}
-
-	return new_fd;
-}
-
-static ssize_t
-task_socket_recv (int fd, void *buf, size_t len, int flags)
-{
-	ssize_t size;
-
-retry:
-	size = recv (fd, buf, len, flags);
-	if (size == -1 && errno == EAGAIN) {
-		hev_task_yield (HEV_TASK_WAITIO);
-		goto retry;
-	}
-
-	return size;
-}
-
-static ssize_t
-task_socket_send (int fd, const void *buf, size_t len, int flags)
-{
-	ssize_t size;
-
-retry:
-	size = send (fd, buf, len, flags);
-	if (size == -1 && errno == EAGAIN) {
-		hev_task_yield (HEV_TASK_WAITIO);
-		goto retry;
-	}
-
-	return size;
-}
-
 static void
 task_client_entry (void *data)
 {
@@ -71,14 +28,14 @@ task_client_entry (void *data)
 	char buf[2048];
 	ssize_t size, s, c = 0;
 
-	size = task_socket_recv (fd, buf, 2048, 0);
+	size = hev_task_io_read (fd, buf, 2048);
 	if (size == -1) {
 		printf ("Receive failed!\n");
 		goto quit;
 	}
 
 retry:
-	s = task_socket_send (fd, buf + c, size - c, 0);
+	s = hev_task_io_write (fd, buf + c, size - c);
 	if (s == -1) {
 		printf ("Send failed!\n");
 		goto quit;
@@ -145,7 +102,7 @@ task_listener_entry (void *data)
 
 retry:
 		addr_len = sizeof (addr);
-		client_fd = task_socket_accept (fd, in_addr, &addr_len);
+		client_fd = hev_task_io_accept (fd, in_addr, &addr_len);
 		if (-1 == client_fd) {
 			printf ("Accept failed!\n");
 			goto retry;
@@ -161,7 +118,7 @@ retry:
 		}
 
 		task = hev_task_new (-1);
-		hev_task_set_priority (task, 1);
+		hev_task_set_priority (task, HEV_TASK_PRIORITY_LOW);
 		hev_task_add_fd (task, client_fd, EPOLLIN | EPOLLOUT);
 		hev_task_run (task, task_client_entry, (void *) (intptr_t) client_fd);
 	}
@@ -173,13 +130,17 @@ int
 main (int argc, char *argv[])
 {
 	HevTask *task;
+	int workers = 1;
+
+	if (argc > 1)
+		workers = atoi (argv[1]);
 
 	hev_task_system_init ();
 
 	task = hev_task_new (-1);
 	hev_task_run (task, task_listener_entry, NULL);
 
-	hev_task_system_run ();
+	hev_task_system_run_workers (workers);
 
 	hev_task_system_fini ();
 
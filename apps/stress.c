@@ -0,0 +1,355 @@
+/*
+ ============================================================================
+ Name        : stress.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Multi-worker stress
+ ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include <hev-task.h>
+#include <hev-task-io.h>
+#include <hev-task-system.h>
+
+#define MAX_SYSTEMS	(256)
+
+static unsigned int worker_count = 4;
+static unsigned int round_count = 8;
+static unsigned int task_count = 64;
+
+static unsigned int step_count = 1000;
+static unsigned int echo_count = 100;
+static unsigned int migrate_count = 100;
+
+/* task systems of workers in current round, seen by tasks */
+static HevTaskSystem *systems[MAX_SYSTEMS];
+static unsigned int system_count;
+static pthread_mutex_t system_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* waiters of all rounds, referenced until the end */
+static HevTask **waiters;
+static unsigned int waiter_count;
+
+static unsigned int round_index;
+static unsigned int round_acked;
+static int quit;
+
+static unsigned int cpu_done;
+static unsigned int cpu_moved;
+static unsigned int echo_done;
+static unsigned int wait_done;
+static unsigned int migrate_done;
+static unsigned int error_count;
+
+static void
+register_system (void)
+{
+	HevTaskSystem *self = hev_task_system_self ();
+	unsigned int i;
+
+	pthread_mutex_lock (&system_mutex);
+	for (i=0; i<system_count; i++)
+		if (systems[i] == self)
+			break;
+	if (i == system_count && system_count < MAX_SYSTEMS)
+		systems[system_count ++] = self;
+	pthread_mutex_unlock (&system_mutex);
+}
+
+static HevTaskSystem *
+pick_system (unsigned int seed)
+{
+	HevTaskSystem *system;
+
+	pthread_mutex_lock (&system_mutex);
+	system = systems[seed % system_count];
+	pthread_mutex_unlock (&system_mutex);
+
+	return system;
+}
+
+static void
+add_error (const char *what)
+{
+	fprintf (stderr, "%s failed!\n", what);
+	__atomic_add_fetch (&error_count, 1, __ATOMIC_RELAXED);
+}
+
+static void
+task_cpu_entry (void *data)
+{
+	HevTaskSystem *system = hev_task_system_self ();
+	unsigned int i, moved = 0;
+
+	register_system ();
+
+	/* movable, shared with idle workers */
+	for (i=0; i<step_count; i++) {
+		hev_task_yield (HEV_TASK_YIELD);
+		if (hev_task_system_self () != system) {
+			system = hev_task_system_self ();
+			register_system ();
+			moved = 1;
+		}
+	}
+
+	__atomic_add_fetch (&cpu_moved, moved, __ATOMIC_RELAXED);
+	__atomic_add_fetch (&cpu_done, 1, __ATOMIC_RELAXED);
+}
+
+static void
+task_ping_entry (void *data)
+{
+	HevTask *task = hev_task_self ();
+	int fd = (intptr_t) data;
+	unsigned int i;
+
+	for (i=0; i<echo_count; i++) {
+		unsigned int value = 0;
+
+		if (hev_task_io_write (fd, &i, sizeof (i)) != sizeof (i)) {
+			add_error ("Ping write");
+			break;
+		}
+		if (hev_task_io_read (fd, &value, sizeof (value)) != sizeof (value) ||
+					value != i) {
+			add_error ("Ping read");
+			break;
+		}
+	}
+
+	hev_task_del_fd (task, fd);
+	close (fd);
+	__atomic_add_fetch (&echo_done, 1, __ATOMIC_RELAXED);
+}
+
+static void
+task_pong_entry (void *data)
+{
+	HevTask *task = hev_task_self ();
+	int fd = (intptr_t) data;
+	unsigned int value;
+
+	/* fds are moved along with task between workers */
+	while (hev_task_io_read (fd, &value, sizeof (value)) == sizeof (value)) {
+		if (hev_task_io_write (fd, &value, sizeof (value)) != sizeof (value)) {
+			add_error ("Pong write");
+			break;
+		}
+	}
+
+	hev_task_del_fd (task, fd);
+	close (fd);
+}
+
+static void
+task_wait_entry (void *data)
+{
+	unsigned int round = (uintptr_t) data;
+	unsigned int i;
+
+	/* parked until woken up by foreign thread */
+	for (i=0; i<step_count / 10; i++)
+		hev_task_yield (HEV_TASK_WAITIO);
+	__atomic_add_fetch (&wait_done, 1, __ATOMIC_RELEASE);
+
+	/* NOTE: wakeups must not race with exit of workers, so exit only
+	 * after foreign thread stopped to wake up tasks of this round */
+	while (__atomic_load_n (&round_acked, __ATOMIC_ACQUIRE) != round)
+		hev_task_sleep (1);
+}
+
+static void
+task_spawn_entry (void *data)
+{
+	unsigned int index = (uintptr_t) data;
+	unsigned int i;
+	HevTask *task;
+
+	/* busy for a while, so that waiter is created on another worker */
+	for (i=0; i<step_count / 10; i++)
+		hev_task_yield (HEV_TASK_YIELD);
+
+	task = hev_task_new (-1);
+	__atomic_store_n (&waiters[index], hev_task_ref (task), __ATOMIC_RELEASE);
+	hev_task_run (task, task_wait_entry, (void *) (uintptr_t) round_index);
+}
+
+static void
+task_migrate_entry (void *data)
+{
+	unsigned int i, seed = (uintptr_t) data;
+
+	register_system ();
+
+	for (i=0; i<migrate_count; i++) {
+		HevTaskSystem *system;
+
+		/* NOTE: may be handed over to an idle worker again at once */
+		seed = seed * 1103515245 + 12345;
+		system = pick_system (seed >> 8);
+		if (hev_task_migrate (hev_task_self (), system) == -1) {
+			add_error ("Migrate");
+			break;
+		}
+		register_system ();
+		hev_task_yield (HEV_TASK_YIELD);
+	}
+
+	__atomic_add_fetch (&migrate_done, 1, __ATOMIC_RELAXED);
+}
+
+static void *
+foreign_thread_entry (void *data)
+{
+	unsigned int count = task_count / 4;
+
+	while (!__atomic_load_n (&quit, __ATOMIC_ACQUIRE)) {
+		unsigned int round = __atomic_load_n (&round_index, __ATOMIC_ACQUIRE);
+		unsigned int i;
+
+		if (!round)
+			continue;
+
+		/* tasks of finished rounds exited, workers are gone */
+		for (i=0; i<(round - 1) * count; i++)
+			hev_task_wakeup (waiters[i]);
+
+		if (__atomic_load_n (&round_acked, __ATOMIC_RELAXED) == round)
+			continue;
+
+		/* remote wakeups, through inbox of worker that owns task */
+		for (; i<round * count; i++) {
+			HevTask *task = __atomic_load_n (&waiters[i], __ATOMIC_ACQUIRE);
+
+			if (task)
+				hev_task_wakeup (task);
+		}
+
+		if (__atomic_load_n (&wait_done, __ATOMIC_ACQUIRE) == count)
+			__atomic_store_n (&round_acked, round, __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+static int
+run_round (unsigned int round)
+{
+	unsigned int i, count = task_count / 4;
+	HevTask *task;
+
+	cpu_done = cpu_moved = echo_done = wait_done = migrate_done = 0;
+	system_count = 0;
+	register_system ();
+	__atomic_store_n (&round_index, round, __ATOMIC_RELEASE);
+
+	for (i=0; i<task_count; i++) {
+		task = hev_task_new (-1);
+		hev_task_run (task, task_cpu_entry, NULL);
+	}
+
+	for (i=0; i<count; i++) {
+		int fds[2];
+
+		if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == -1)
+			return -1;
+
+		task = hev_task_new (-1);
+		hev_task_add_fd (task, fds[0], EPOLLIN | EPOLLOUT);
+		hev_task_run (task, task_ping_entry, (void *) (intptr_t) fds[0]);
+
+		task = hev_task_new (-1);
+		hev_task_add_fd (task, fds[1], EPOLLIN | EPOLLOUT);
+		hev_task_run (task, task_pong_entry, (void *) (intptr_t) fds[1]);
+	}
+
+	for (i=0; i<count; i++) {
+		task = hev_task_new (-1);
+		hev_task_run (task, task_spawn_entry,
+					(void *) (uintptr_t) waiter_count ++);
+	}
+
+	for (i=0; i<count; i++) {
+		task = hev_task_new (-1);
+		hev_task_run (task, task_migrate_entry, (void *) (uintptr_t) i);
+	}
+
+	if (hev_task_system_run_workers (worker_count) == -1)
+		return -1;
+
+	printf ("round %u: %u systems, cpu %u/%u moved %u, echo %u/%u, "
+			"wait %u/%u, migrate %u/%u\n", round, system_count,
+			cpu_done, task_count, cpu_moved, echo_done, count,
+			wait_done, count, migrate_done, count);
+
+	if (cpu_done != task_count || echo_done != count ||
+				wait_done != count || migrate_done != count)
+		add_error ("Round");
+
+	return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+	pthread_t thread;
+	unsigned int i;
+	int res = 0;
+
+	if (argc > 1)
+		worker_count = strtoul (argv[1], NULL, 10);
+	if (argc > 2)
+		round_count = strtoul (argv[2], NULL, 10);
+	if (argc > 3)
+		task_count = strtoul (argv[3], NULL, 10);
+
+	if (task_count < 4 || worker_count > MAX_SYSTEMS) {
+		fprintf (stderr, "Usage: %s [workers] [rounds] [tasks >= 4]\n",
+					argv[0]);
+		return -1;
+	}
+
+	waiters = calloc (round_count * (task_count / 4), sizeof (HevTask *));
+	if (!waiters)
+		return -1;
+
+	if (hev_task_system_init () == -1)
+		return -1;
+
+	if (pthread_create (&thread, NULL, foreign_thread_entry, NULL) != 0)
+		return -1;
+
+	/* worker systems are finalized at end of each round */
+	for (i=1; i<=round_count; i++) {
+		if (run_round (i) == -1) {
+			add_error ("Run workers");
+			break;
+		}
+	}
+
+	/* keep waking up exited tasks for a while after the last round */
+	usleep (10000);
+	__atomic_store_n (&quit, 1, __ATOMIC_RELEASE);
+	pthread_join (thread, NULL);
+
+	for (i=0; i<waiter_count; i++)
+		hev_task_unref (waiters[i]);
+
+	hev_task_system_fini ();
+	free (waiters);
+
+	if (error_count) {
+		printf ("%u errors\n", error_count);
+		res = -1;
+	}
+
+	return res;
+}
@@ -49,7 +49,7 @@ main (int argc, char *argv[])
 	hev_task_run (task1, task_entry1, NULL);
 
 	task2 = hev_task_new (-1);
-	hev_task_set_priority (task2, 1);
+	hev_task_set_priority (task2, HEV_TASK_PRIORITY_LOW);
 	hev_task_run (task2, task_entry2, task1);
 
 	hev_task_system_run ();
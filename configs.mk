@@ -2,13 +2,25 @@
 
 ENABLE_PTHREAD := 1
 ENABLE_STACK_OVERFLOW_DETECTION := 1
+ENABLE_MMAP_STACK := 1
+ENABLE_TASK_STACK_COALLOC := 1
 ENABLE_MEMALLOC_SLICE := 1
+ENABLE_SETJMP_CONTEXT := 0
+ENABLE_IO_URING := 0
 
 CONFIG_MEMALLOC_SLICE_ALIGN := 64
 CONFIG_MEMALLOC_SLICE_MAX_SIZE := 0x100000
 CONFIG_MEMALLOC_SLICE_MAX_COUNT := 1000
 
-CONFIG_TASK_TIMER_MAX_COUNT := 100
+CONFIG_TASK_PRIORITY_COUNT := 32
+CONFIG_TASK_STACK_CACHE_MAX_SIZE := 0x1000000
+CONFIG_TASK_CACHE_MAX_COUNT := 128
+CONFIG_TASK_SHARED_STACK_SIZE := 0x40000
+CONFIG_TASK_IO_POLL_INTERVAL := 64
+CONFIG_TASK_IO_POLL_BUDGET := 1000
+CONFIG_TASK_TIME_SLICE := 1000
+CONFIG_TASK_TIMER_SLACK := 0
+CONFIG_TASK_IO_URING_ENTRIES := 256
 
 
 CONFIG_CFLAGS :=
@@ -21,11 +33,35 @@ ifeq ($(ENABLE_STACK_OVERFLOW_DETECTION),1)
 	CONFIG_CFLAGS+=-DENABLE_STACK_OVERFLOW_DETECTION
 endif
 
+ifeq ($(ENABLE_MMAP_STACK),1)
+	CONFIG_CFLAGS+=-DENABLE_MMAP_STACK
+endif
+
+ifeq ($(ENABLE_TASK_STACK_COALLOC),1)
+	CONFIG_CFLAGS+=-DENABLE_TASK_STACK_COALLOC
+endif
+
 ifeq ($(ENABLE_MEMALLOC_SLICE),1)
 	CONFIG_CFLAGS+=-DENABLE_MEMALLOC_SLICE
 endif
 
+ifeq ($(ENABLE_SETJMP_CONTEXT),1)
+	CONFIG_CFLAGS+=-DENABLE_SETJMP_CONTEXT
+endif
+
+ifeq ($(ENABLE_IO_URING),1)
+	CONFIG_CFLAGS+=-DENABLE_IO_URING
+endif
+
 CONFIG_CFLAGS+=-DCONFIG_MEMALLOC_SLICE_ALIGN=$(CONFIG_MEMALLOC_SLICE_ALIGN)
 CONFIG_CFLAGS+=-DCONFIG_MEMALLOC_SLICE_MAX_SIZE=$(CONFIG_MEMALLOC_SLICE_MAX_SIZE)
 CONFIG_CFLAGS+=-DCONFIG_MEMALLOC_SLICE_MAX_COUNT=$(CONFIG_MEMALLOC_SLICE_MAX_COUNT)
-CONFIG_CFLAGS+=-DCONFIG_TASK_TIMER_MAX_COUNT=$(CONFIG_TASK_TIMER_MAX_COUNT)
+CONFIG_CFLAGS+=-DCONFIG_TASK_PRIORITY_COUNT=$(CONFIG_TASK_PRIORITY_COUNT)
+CONFIG_CFLAGS+=-DCONFIG_TASK_STACK_CACHE_MAX_SIZE=$(CONFIG_TASK_STACK_CACHE_MAX_SIZE)
+CONFIG_CFLAGS+=-DCONFIG_TASK_CACHE_MAX_COUNT=$(CONFIG_TASK_CACHE_MAX_COUNT)
+CONFIG_CFLAGS+=-DCONFIG_TASK_SHARED_STACK_SIZE=$(CONFIG_TASK_SHARED_STACK_SIZE)
+CONFIG_CFLAGS+=-DCONFIG_TASK_IO_POLL_INTERVAL=$(CONFIG_TASK_IO_POLL_INTERVAL)
+CONFIG_CFLAGS+=-DCONFIG_TASK_IO_POLL_BUDGET=$(CONFIG_TASK_IO_POLL_BUDGET)
+CONFIG_CFLAGS+=-DCONFIG_TASK_TIME_SLICE=$(CONFIG_TASK_TIME_SLICE)
+CONFIG_CFLAGS+=-DCONFIG_TASK_TIMER_SLACK=$(CONFIG_TASK_TIMER_SLACK)
+CONFIG_CFLAGS+=-DCONFIG_TASK_IO_URING_ENTRIES=$(CONFIG_TASK_IO_URING_ENTRIES)
@@ -0,0 +1 @@
+../src/hev-task-io.h
\ No newline at end of file
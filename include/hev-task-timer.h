@@ -0,0 +1 @@
+../src/hev-task-timer.h
\ No newline at end of file
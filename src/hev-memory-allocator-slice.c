@@ -27,7 +27,9 @@ typedef struct _HevMemoryLRUNode HevMemoryLRUNode;
 struct _HevMemorySlice
 {
 	HevMemorySlice *next;
-	HevMemorySlice **owner;
+	/* size class, 0 means not cached. NOTE: not a pointer into the cache of
+	 * allocator, slice may be freed by a thread other than the allocator's */
+	size_t index;
 };
 
 struct _HevMemoryLRUNode
@@ -103,7 +105,7 @@ _hev_memory_allocator_alloc (HevMemoryAllocator *allocator, size_t size)
 		slice = malloc (sizeof (HevMemorySlice) + size);
 		if (!slice)
 			return NULL;
-		slice->owner = NULL;
+		slice->index = 0;
 		return slice + 1;
 	}
 
@@ -126,7 +128,7 @@ _hev_memory_allocator_alloc (HevMemoryAllocator *allocator, size_t size)
 		if (!slice)
 			return NULL;
 
-		slice->owner = owner;
+		slice->index = index;
 	}
 
 	return slice + 1;
@@ -137,16 +139,19 @@ _hev_memory_allocator_free (HevMemoryAllocator *allocator, void *ptr)
 {
 	HevMemoryAllocatorSlice *self = (HevMemoryAllocatorSlice *) allocator;
 	HevMemorySlice *slice = (HevMemorySlice *) ptr - 1;
+	HevMemorySlice **owner;
 
-	if (!slice->owner) {
+	if (!slice->index) {
 		free (slice);
 		return;
 	}
 
 	if (self->cached_count >= MAX_CACHED_SLICE_COUNT) {
 		HevMemoryLRUNode *node = self->lru_tail;
-		HevMemorySlice **owner = &self->cached_mslices[node - self->lru_nodes];
-		HevMemorySlice *free_slice = *owner;
+		HevMemorySlice *free_slice;
+
+		owner = &self->cached_mslices[node - self->lru_nodes];
+		free_slice = *owner;
 
 		*owner = free_slice->next;
 		self->cached_count --;
@@ -157,14 +162,15 @@ _hev_memory_allocator_free (HevMemoryAllocator *allocator, void *ptr)
 		free (free_slice);
 	}
 
-	slice->next = *slice->owner;
-	*slice->owner = slice;
+	owner = &self->cached_mslices[slice->index - 1];
+	slice->next = *owner;
+	*owner = slice;
 	self->cached_count ++;
 
 	if (!slice->next) {
 		HevMemoryLRUNode *node;
 
-		node = &self->lru_nodes[slice->owner - self->cached_mslices];
+		node = &self->lru_nodes[slice->index - 1];
 		_hev_memory_allocator_lru_insert (self, node);
 	}
 
@@ -15,16 +15,19 @@
 
 #include "hev-memory-allocator.h"
 #include "hev-memory-allocator-interface.h"
+#include "hev-memory-allocator-slice.h"
 
 #ifdef ENABLE_PTHREAD
 static pthread_key_t key;
 static pthread_once_t key_once = PTHREAD_ONCE_INIT;
 
 static void pthread_key_creator (void);
+static void pthread_key_destructor (void *data);
 #else
 static HevMemoryAllocator *default_allocator;
 #endif
 
+static HevMemoryAllocator * hev_memory_allocator_default_new (void);
 static void * _hev_memory_allocator_alloc (HevMemoryAllocator *self, size_t size);
 static void _hev_memory_allocator_free (HevMemoryAllocator *self, void *ptr);
 
@@ -38,12 +41,12 @@ hev_memory_allocator_default (void)
 
 	default_allocator = pthread_getspecific (key);
 	if (!default_allocator) {
-		default_allocator = hev_memory_allocator_new ();
+		default_allocator = hev_memory_allocator_default_new ();
 		pthread_setspecific (key, default_allocator);
 	}
 #else
 	if (!default_allocator)
-		default_allocator = hev_memory_allocator_new ();
+		default_allocator = hev_memory_allocator_default_new ();
 #endif
 
 	return default_allocator;
@@ -107,10 +110,28 @@ hev_memory_allocator_unref (HevMemoryAllocator *self)
 static void
 pthread_key_creator (void)
 {
-	pthread_key_create (&key, NULL);
+	pthread_key_create (&key, pthread_key_destructor);
+}
+
+static void
+pthread_key_destructor (void *data)
+{
+	hev_memory_allocator_unref (data);
 }
 #endif
 
+static HevMemoryAllocator *
+hev_memory_allocator_default_new (void)
+{
+	/* NOTE: memory may be freed in any thread of the task system,
+	 * all threads must use allocators of the same kind */
+#ifdef ENABLE_MEMALLOC_SLICE
+	return hev_memory_allocator_slice_new ();
+#else
+	return hev_memory_allocator_new ();
+#endif
+}
+
 static void *
 _hev_memory_allocator_alloc (HevMemoryAllocator *self, size_t size)
 {
@@ -0,0 +1,67 @@
+/*
+ ============================================================================
+ Name        : hev-task-clock.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Task clock
+ ============================================================================
+ */
+
+#include "hev-task-clock.h"
+
+#define CALIBRATE_TIME	(1000000) /* ns */
+
+static unsigned int cycles_per_usec;
+
+static unsigned int hev_task_clock_calibrate (void);
+
+unsigned int
+hev_task_clock_cycles_per_usec (void)
+{
+	unsigned int value;
+
+	/* NOTE: calibrated once, racing threads get the same result */
+	value = __atomic_load_n (&cycles_per_usec, __ATOMIC_RELAXED);
+	if (!value) {
+		value = hev_task_clock_calibrate ();
+		__atomic_store_n (&cycles_per_usec, value, __ATOMIC_RELAXED);
+	}
+
+	return value;
+}
+
+static inline uint64_t
+hev_task_clock_get_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static unsigned int
+hev_task_clock_calibrate (void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	uint64_t t0, t1, c0, c1;
+
+	/* spin for a while, TSC is constant rate on any recent CPU */
+	t0 = hev_task_clock_get_time ();
+	c0 = hev_task_clock_cycles ();
+	do {
+		t1 = hev_task_clock_get_time ();
+	} while ((t1 - t0) < CALIBRATE_TIME);
+	c1 = hev_task_clock_cycles ();
+
+	return ((c1 - c0) * 1000 / (t1 - t0)) ? : 1;
+#elif defined(__aarch64__)
+	uint64_t freq;
+
+	__asm__ __volatile__ ("mrs %0, cntfrq_el0" : "=r" (freq));
+	return (freq / 1000000) ? : 1;
+#else
+	return 1000;
+#endif
+}
+
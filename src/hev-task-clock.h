@@ -0,0 +1,53 @@
+/*
+ ============================================================================
+ Name        : hev-task-clock.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Task clock
+ ============================================================================
+ */
+
+#ifndef __HEV_TASK_CLOCK_H__
+#define __HEV_TASK_CLOCK_H__
+
+#include <time.h>
+#include <stdint.h>
+
+/*
+ * Cheap monotonic counter of the current CPU, in an unspecified unit:
+ * TSC on x86, virtual counter on aarch64, nanoseconds elsewhere. Use
+ * hev_task_clock_cycles_per_usec() to convert.
+ */
+static inline uint64_t
+hev_task_clock_cycles (void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	return __builtin_ia32_rdtsc ();
+#elif defined(__aarch64__)
+	uint64_t value;
+
+	__asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (value));
+	return value;
+#else
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+unsigned int hev_task_clock_cycles_per_usec (void);
+
+/* monotonic time, in microseconds, vDSO */
+static inline uint64_t
+hev_task_clock_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#endif /* __HEV_TASK_CLOCK_H__ */
+
@@ -0,0 +1,51 @@
+/*
+ ============================================================================
+ Name        : hev-task-context-aarch64.s
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description :
+ ============================================================================
+ */
+
+	.globl  hev_task_context_save
+	.type   hev_task_context_save, %function
+
+hev_task_context_save:
+	stp	x19, x20, [x0, 0x00]
+	stp	x21, x22, [x0, 0x10]
+	stp	x23, x24, [x0, 0x20]
+	stp	x25, x26, [x0, 0x30]
+	stp	x27, x28, [x0, 0x40]
+	stp	x29, x30, [x0, 0x50]
+	mov	x2, sp
+	str	x2, [x0, 0x60]
+	stp	d8, d9, [x0, 0x68]
+	stp	d10, d11, [x0, 0x78]
+	stp	d12, d13, [x0, 0x88]
+	stp	d14, d15, [x0, 0x98]
+	mov	x0, 0
+	ret
+
+	.size   hev_task_context_save, . - hev_task_context_save
+
+	.globl  hev_task_context_restore
+	.type   hev_task_context_restore, %function
+
+hev_task_context_restore:
+	ldp	x19, x20, [x0, 0x00]
+	ldp	x21, x22, [x0, 0x10]
+	ldp	x23, x24, [x0, 0x20]
+	ldp	x25, x26, [x0, 0x30]
+	ldp	x27, x28, [x0, 0x40]
+	ldp	x29, x30, [x0, 0x50]
+	ldr	x2, [x0, 0x60]
+	ldp	d8, d9, [x0, 0x68]
+	ldp	d10, d11, [x0, 0x78]
+	ldp	d12, d13, [x0, 0x88]
+	ldp	d14, d15, [x0, 0x98]
+	mov	sp, x2
+	mov	w0, w1
+	ret
+
+	.size   hev_task_context_restore, . - hev_task_context_restore
+
@@ -0,0 +1,37 @@
+/*
+ ============================================================================
+ Name        : hev-task-context-arm.s
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description :
+ ============================================================================
+ */
+
+	.globl  hev_task_context_save
+	.type   hev_task_context_save, %function
+
+hev_task_context_save:
+	mov	ip, sp
+	stmia	r0!, {r4-r11, ip, lr}
+#ifndef __SOFTFP__
+	vstmia	r0, {d8-d15}
+#endif
+	mov	r0, #0
+	bx	lr
+
+	.size   hev_task_context_save, . - hev_task_context_save
+
+	.globl  hev_task_context_restore
+	.type   hev_task_context_restore, %function
+
+hev_task_context_restore:
+	ldmia	r0!, {r4-r11, ip, lr}
+#ifndef __SOFTFP__
+	vldmia	r0, {d8-d15}
+#endif
+	mov	sp, ip
+	mov	r0, r1
+	bx	lr
+
+	.size   hev_task_context_restore, . - hev_task_context_restore
+
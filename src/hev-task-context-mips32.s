@@ -0,0 +1,71 @@
+/*
+ ============================================================================
+ Name        : hev-task-context-mips32.s
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description :
+ ============================================================================
+ */
+
+	.globl  hev_task_context_save
+	.ent    hev_task_context_save, 0
+	.type   hev_task_context_save, @function
+
+hev_task_context_save:
+	sw	$s0, 0x00($a0)
+	sw	$s1, 0x04($a0)
+	sw	$s2, 0x08($a0)
+	sw	$s3, 0x0c($a0)
+	sw	$s4, 0x10($a0)
+	sw	$s5, 0x14($a0)
+	sw	$s6, 0x18($a0)
+	sw	$s7, 0x1c($a0)
+	sw	$fp, 0x20($a0)
+	sw	$gp, 0x24($a0)
+	sw	$sp, 0x28($a0)
+	sw	$ra, 0x2c($a0)
+#ifndef __mips_soft_float
+	sdc1	$f20, 0x30($a0)
+	sdc1	$f22, 0x38($a0)
+	sdc1	$f24, 0x40($a0)
+	sdc1	$f26, 0x48($a0)
+	sdc1	$f28, 0x50($a0)
+	sdc1	$f30, 0x58($a0)
+#endif
+	move	$v0, $zero
+	jr	$ra
+
+	.end    hev_task_context_save
+	.size   hev_task_context_save, . - hev_task_context_save
+
+	.globl  hev_task_context_restore
+	.ent    hev_task_context_restore, 0
+	.type   hev_task_context_restore, @function
+
+hev_task_context_restore:
+	lw	$s0, 0x00($a0)
+	lw	$s1, 0x04($a0)
+	lw	$s2, 0x08($a0)
+	lw	$s3, 0x0c($a0)
+	lw	$s4, 0x10($a0)
+	lw	$s5, 0x14($a0)
+	lw	$s6, 0x18($a0)
+	lw	$s7, 0x1c($a0)
+	lw	$fp, 0x20($a0)
+	lw	$gp, 0x24($a0)
+	lw	$sp, 0x28($a0)
+	lw	$ra, 0x2c($a0)
+#ifndef __mips_soft_float
+	ldc1	$f20, 0x30($a0)
+	ldc1	$f22, 0x38($a0)
+	ldc1	$f24, 0x40($a0)
+	ldc1	$f26, 0x48($a0)
+	ldc1	$f28, 0x50($a0)
+	ldc1	$f30, 0x58($a0)
+#endif
+	move	$v0, $a1
+	jr	$ra
+
+	.end    hev_task_context_restore
+	.size   hev_task_context_restore, . - hev_task_context_restore
+
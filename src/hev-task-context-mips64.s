@@ -0,0 +1,75 @@
+/*
+ ============================================================================
+ Name        : hev-task-context-mips64.s
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description :
+ ============================================================================
+ */
+
+	.globl  hev_task_context_save
+	.ent    hev_task_context_save, 0
+	.type   hev_task_context_save, @function
+
+hev_task_context_save:
+	sd	$s0, 0x00($a0)
+	sd	$s1, 0x08($a0)
+	sd	$s2, 0x10($a0)
+	sd	$s3, 0x18($a0)
+	sd	$s4, 0x20($a0)
+	sd	$s5, 0x28($a0)
+	sd	$s6, 0x30($a0)
+	sd	$s7, 0x38($a0)
+	sd	$fp, 0x40($a0)
+	sd	$gp, 0x48($a0)
+	sd	$sp, 0x50($a0)
+	sd	$ra, 0x58($a0)
+#ifndef __mips_soft_float
+	sdc1	$f24, 0x60($a0)
+	sdc1	$f25, 0x68($a0)
+	sdc1	$f26, 0x70($a0)
+	sdc1	$f27, 0x78($a0)
+	sdc1	$f28, 0x80($a0)
+	sdc1	$f29, 0x88($a0)
+	sdc1	$f30, 0x90($a0)
+	sdc1	$f31, 0x98($a0)
+#endif
+	move	$v0, $zero
+	jr	$ra
+
+	.end    hev_task_context_save
+	.size   hev_task_context_save, . - hev_task_context_save
+
+	.globl  hev_task_context_restore
+	.ent    hev_task_context_restore, 0
+	.type   hev_task_context_restore, @function
+
+hev_task_context_restore:
+	ld	$s0, 0x00($a0)
+	ld	$s1, 0x08($a0)
+	ld	$s2, 0x10($a0)
+	ld	$s3, 0x18($a0)
+	ld	$s4, 0x20($a0)
+	ld	$s5, 0x28($a0)
+	ld	$s6, 0x30($a0)
+	ld	$s7, 0x38($a0)
+	ld	$fp, 0x40($a0)
+	ld	$gp, 0x48($a0)
+	ld	$sp, 0x50($a0)
+	ld	$ra, 0x58($a0)
+#ifndef __mips_soft_float
+	ldc1	$f24, 0x60($a0)
+	ldc1	$f25, 0x68($a0)
+	ldc1	$f26, 0x70($a0)
+	ldc1	$f27, 0x78($a0)
+	ldc1	$f28, 0x80($a0)
+	ldc1	$f29, 0x88($a0)
+	ldc1	$f30, 0x90($a0)
+	ldc1	$f31, 0x98($a0)
+#endif
+	move	$v0, $a1
+	jr	$ra
+
+	.end    hev_task_context_restore
+	.size   hev_task_context_restore, . - hev_task_context_restore
+
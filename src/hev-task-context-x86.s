@@ -0,0 +1,42 @@
+/*
+ ============================================================================
+ Name        : hev-task-context-x86.s
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description :
+ ============================================================================
+ */
+
+	.globl  hev_task_context_save
+	.type   hev_task_context_save, @function
+
+hev_task_context_save:
+	mov	0x4(%esp), %ecx
+	mov	(%esp), %edx
+	lea	0x4(%esp), %eax
+	mov	%ebx, 0x00(%ecx)
+	mov	%esi, 0x04(%ecx)
+	mov	%edi, 0x08(%ecx)
+	mov	%ebp, 0x0c(%ecx)
+	mov	%eax, 0x10(%ecx)
+	mov	%edx, 0x14(%ecx)
+	xor	%eax, %eax
+	ret
+
+	.size   hev_task_context_save, . - hev_task_context_save
+
+	.globl  hev_task_context_restore
+	.type   hev_task_context_restore, @function
+
+hev_task_context_restore:
+	mov	0x4(%esp), %ecx
+	mov	0x8(%esp), %eax
+	mov	0x00(%ecx), %ebx
+	mov	0x04(%ecx), %esi
+	mov	0x08(%ecx), %edi
+	mov	0x0c(%ecx), %ebp
+	mov	0x10(%ecx), %esp
+	jmp	*0x14(%ecx)
+
+	.size   hev_task_context_restore, . - hev_task_context_restore
+
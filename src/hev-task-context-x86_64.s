@@ -0,0 +1,44 @@
+/*
+ ============================================================================
+ Name        : hev-task-context-x86_64.s
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description :
+ ============================================================================
+ */
+
+	.globl  hev_task_context_save
+	.type   hev_task_context_save, @function
+
+hev_task_context_save:
+	movq	(%rsp), %rax
+	leaq	0x08(%rsp), %rcx
+	movq	%rbx, 0x00(%rdi)
+	movq	%rbp, 0x08(%rdi)
+	movq	%r12, 0x10(%rdi)
+	movq	%r13, 0x18(%rdi)
+	movq	%r14, 0x20(%rdi)
+	movq	%r15, 0x28(%rdi)
+	movq	%rcx, 0x30(%rdi)
+	movq	%rax, 0x38(%rdi)
+	xorl	%eax, %eax
+	retq
+
+	.size   hev_task_context_save, . - hev_task_context_save
+
+	.globl  hev_task_context_restore
+	.type   hev_task_context_restore, @function
+
+hev_task_context_restore:
+	movq	0x00(%rdi), %rbx
+	movq	0x08(%rdi), %rbp
+	movq	0x10(%rdi), %r12
+	movq	0x18(%rdi), %r13
+	movq	0x20(%rdi), %r14
+	movq	0x28(%rdi), %r15
+	movq	0x30(%rdi), %rsp
+	movl	%esi, %eax
+	jmpq	*0x38(%rdi)
+
+	.size   hev_task_context_restore, . - hev_task_context_restore
+
@@ -0,0 +1,62 @@
+/*
+ ============================================================================
+ Name        : hev-task-context.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Task context
+ ============================================================================
+ */
+
+#ifndef __HEV_TASK_CONTEXT_H__
+#define __HEV_TASK_CONTEXT_H__
+
+#ifdef ENABLE_SETJMP_CONTEXT
+
+#include <setjmp.h>
+
+typedef jmp_buf HevTaskContext;
+
+#define hev_task_context_save(context) \
+	setjmp (context)
+#define hev_task_context_restore(context, value) \
+	longjmp (context, value)
+
+#else /* ENABLE_SETJMP_CONTEXT */
+
+#include <stdint.h>
+
+/* callee-saved registers, stack pointer and return address */
+#if defined(__i386__)
+# define HEV_TASK_CONTEXT_SIZE	(6)
+#elif defined(__x86_64__)
+# define HEV_TASK_CONTEXT_SIZE	(8)
+#elif defined(__mips__)
+# if (_MIPS_SIM == _ABI64)
+#  define HEV_TASK_CONTEXT_SIZE	(20)
+# else
+#  define HEV_TASK_CONTEXT_SIZE	(24)
+# endif
+#elif defined(__arm__)
+# define HEV_TASK_CONTEXT_SIZE	(26)
+#elif defined(__aarch64__)
+# define HEV_TASK_CONTEXT_SIZE	(22)
+#else
+# error "Unsupported platform!"
+#endif
+
+typedef uintptr_t HevTaskContext[HEV_TASK_CONTEXT_SIZE] __attribute__ ((aligned (16)));
+
+/*
+ * Like setjmp/longjmp, but only callee-saved registers, stack pointer
+ * and return address are saved. Signal mask is untouched. The @value
+ * passed to hev_task_context_restore must be non-zero.
+ */
+extern int hev_task_context_save (HevTaskContext context)
+			__attribute__ ((returns_twice));
+extern void hev_task_context_restore (HevTaskContext context, int value)
+			__attribute__ ((noreturn));
+
+#endif /* !ENABLE_SETJMP_CONTEXT */
+
+#endif /* __HEV_TASK_CONTEXT_H__ */
+
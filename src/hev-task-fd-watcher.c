@@ -0,0 +1,177 @@
+/*
+ ============================================================================
+ Name        : hev-task-fd-watcher.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Task fd watcher
+ ============================================================================
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+
+#include "hev-task-fd-watcher.h"
+#include "hev-memory-allocator.h"
+
+static HevTaskFDWatcher * hev_task_fd_watcher_get (HevTaskSystemContext *ctx,
+			int fd);
+static int hev_task_fd_watcher_update (HevTaskFDWatcher *self, int epoll_fd,
+			unsigned int events);
+
+int
+hev_task_fd_watcher_add (HevTaskSystemContext *ctx, HevTaskFD *task_fd)
+{
+	HevTaskFDWatcher *self = task_fd->watcher;
+	unsigned int events;
+	HevTaskFD *iter;
+
+	if (!self) {
+		self = hev_task_fd_watcher_get (ctx, task_fd->fd);
+		if (!self)
+			return -1;
+
+		task_fd->watcher = self;
+		task_fd->watcher_next = self->waiters;
+		self->waiters = task_fd;
+	}
+
+	events = 0;
+	for (iter=self->waiters; iter; iter=iter->watcher_next)
+		events |= iter->events;
+
+	/* always, fd may be closed and reused, and a new edge is reported */
+	if (hev_task_fd_watcher_update (self, ctx->epoll_fd, events) == -1) {
+		hev_task_fd_watcher_unlink (task_fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+int
+hev_task_fd_watcher_remove (HevTaskSystemContext *ctx, HevTaskFD *task_fd)
+{
+	HevTaskFDWatcher *self = task_fd->watcher;
+	unsigned int events;
+	HevTaskFD *iter;
+
+	if (!self)
+		return 0;
+
+	hev_task_fd_watcher_unlink (task_fd);
+
+	events = 0;
+	for (iter=self->waiters; iter; iter=iter->watcher_next)
+		events |= iter->events;
+
+	if (events == self->events)
+		return 0;
+
+	return hev_task_fd_watcher_update (self, ctx->epoll_fd, events);
+}
+
+void
+hev_task_fd_watcher_unlink (HevTaskFD *task_fd)
+{
+	HevTaskFDWatcher *self = task_fd->watcher;
+	HevTaskFD **prev;
+
+	if (!self)
+		return;
+
+	/* NOTE: registration is kept, events with no waiter are dropped */
+	for (prev=&self->waiters; *prev!=task_fd; prev=&(*prev)->watcher_next);
+	*prev = task_fd->watcher_next;
+	task_fd->watcher = NULL;
+}
+
+void
+hev_task_fd_watcher_free_all (HevTaskSystemContext *ctx)
+{
+	unsigned int i;
+
+	for (i=0; i<ctx->fd_watcher_size; i++) {
+		if (ctx->fd_watchers[i])
+			hev_free (ctx->fd_watchers[i]);
+	}
+
+	if (ctx->fd_watchers)
+		hev_free (ctx->fd_watchers);
+}
+
+static HevTaskFDWatcher *
+hev_task_fd_watcher_get (HevTaskSystemContext *ctx, int fd)
+{
+	HevTaskFDWatcher *self;
+
+	if (fd < 0) {
+		errno = EBADF;
+		return NULL;
+	}
+
+	if (fd >= ctx->fd_watcher_size) {
+		unsigned int size = ctx->fd_watcher_size ? ctx->fd_watcher_size : 64;
+		HevTaskFDWatcher **watchers;
+
+		while (size <= fd)
+			size *= 2;
+
+		watchers = hev_malloc0 (sizeof (HevTaskFDWatcher *) * size);
+		if (!watchers)
+			return NULL;
+		if (ctx->fd_watchers) {
+			memcpy (watchers, ctx->fd_watchers,
+						sizeof (HevTaskFDWatcher *) * ctx->fd_watcher_size);
+			hev_free (ctx->fd_watchers);
+		}
+		ctx->fd_watchers = watchers;
+		ctx->fd_watcher_size = size;
+	}
+
+	self = ctx->fd_watchers[fd];
+	if (!self) {
+		self = hev_malloc0 (sizeof (HevTaskFDWatcher));
+		if (!self)
+			return NULL;
+
+		self->fd = fd;
+		ctx->fd_watchers[fd] = self;
+	}
+
+	return self;
+}
+
+static int
+hev_task_fd_watcher_update (HevTaskFDWatcher *self, int epoll_fd,
+			unsigned int events)
+{
+	struct epoll_event event;
+	int op;
+
+	if (!events) {
+		self->events = 0;
+		return epoll_ctl (epoll_fd, EPOLL_CTL_DEL, self->fd, NULL);
+	}
+
+	event.events = EPOLLET | events;
+	event.data.ptr = self;
+
+	op = self->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	if (epoll_ctl (epoll_fd, op, self->fd, &event) == -1) {
+		/* closed and removed by kernel, or the other way round */
+		if (errno == ENOENT)
+			op = EPOLL_CTL_ADD;
+		else if (errno == EEXIST)
+			op = EPOLL_CTL_MOD;
+		else
+			return -1;
+
+		if (epoll_ctl (epoll_fd, op, self->fd, &event) == -1)
+			return -1;
+	}
+
+	self->events = events;
+	return 0;
+}
+
@@ -0,0 +1,39 @@
+/*
+ ============================================================================
+ Name        : hev-task-fd-watcher.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Task fd watcher
+ ============================================================================
+ */
+
+#ifndef __HEV_TASK_FD_WATCHER_H__
+#define __HEV_TASK_FD_WATCHER_H__
+
+#include "hev-task-private.h"
+#include "hev-task-system-private.h"
+
+typedef struct _HevTaskFDWatcher HevTaskFDWatcher;
+
+/*
+ * I/O poll registration of a fd in a task system, data of epoll events.
+ * Tasks added the fd are waiters, e.g. a reader and a writer, and events
+ * are delivered to the ones waiting for them. Kept until the task system
+ * exits, so events of closed fds never point to freed memory.
+ */
+struct _HevTaskFDWatcher
+{
+	HevTaskFD *waiters;
+
+	int fd;
+	unsigned int events; /* registered, union of waiters */
+};
+
+int hev_task_fd_watcher_add (HevTaskSystemContext *ctx, HevTaskFD *task_fd);
+int hev_task_fd_watcher_remove (HevTaskSystemContext *ctx, HevTaskFD *task_fd);
+void hev_task_fd_watcher_unlink (HevTaskFD *task_fd);
+
+void hev_task_fd_watcher_free_all (HevTaskSystemContext *ctx);
+
+#endif /* __HEV_TASK_FD_WATCHER_H__ */
+
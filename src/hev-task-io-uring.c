@@ -0,0 +1,280 @@
+/*
+ ============================================================================
+ Name        : hev-task-io-uring.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Task I/O uring
+ ============================================================================
+ */
+
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/* NOTE: ENABLE_IO_URING is reset here if kernel headers are too old */
+#include "hev-task-system-private.h"
+
+#ifdef ENABLE_IO_URING
+
+#include "hev-task-io-uring.h"
+#include "hev-task-private.h"
+#include "hev-memory-allocator.h"
+
+/* completions by kernel without a punt to worker threads, wait with
+ * a timeout for timers: 5.11 */
+#define REQUIRED_FEATURES \
+	(IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_FAST_POLL | \
+	 IORING_FEAT_EXT_ARG)
+
+struct _HevTaskIOUring
+{
+	int fd;
+
+	unsigned int sq_tail;
+	unsigned int sq_pending;
+	unsigned int sq_entries;
+	unsigned int sq_mask;
+	unsigned int cq_mask;
+
+	unsigned int *sq_khead;
+	unsigned int *sq_ktail;
+	unsigned int *sq_kflags;
+	unsigned int *cq_khead;
+	unsigned int *cq_ktail;
+
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+
+	void *ring;
+	size_t ring_size;
+	size_t sqes_size;
+};
+
+static int hev_task_io_uring_submit (HevTaskIOUring *self, int timeout);
+static void hev_task_io_uring_cancel (HevTaskIOUring *self,
+			HevTaskIOUringOp *op);
+
+HevTaskIOUring *
+hev_task_io_uring_new (unsigned int entries)
+{
+	HevTaskIOUring *self;
+	struct io_uring_params params;
+	unsigned int *array;
+	size_t cq_size;
+	unsigned int i;
+	void *ring;
+
+	self = hev_malloc0 (sizeof (HevTaskIOUring));
+	if (!self)
+		return NULL;
+
+	memset (&params, 0, sizeof (params));
+	self->fd = syscall (__NR_io_uring_setup, entries, &params);
+	if (self->fd == -1)
+		goto free_self;
+
+	/* old kernel, use epoll */
+	if ((params.features & REQUIRED_FEATURES) != REQUIRED_FEATURES)
+		goto close_fd;
+
+	self->ring_size = params.sq_off.array +
+		params.sq_entries * sizeof (unsigned int);
+	cq_size = params.cq_off.cqes +
+		params.cq_entries * sizeof (struct io_uring_cqe);
+	if (cq_size > self->ring_size)
+		self->ring_size = cq_size;
+
+	ring = mmap (NULL, self->ring_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, self->fd, IORING_OFF_SQ_RING);
+	if (ring == MAP_FAILED)
+		goto close_fd;
+	self->ring = ring;
+
+	self->sqes_size = params.sq_entries * sizeof (struct io_uring_sqe);
+	self->sqes = mmap (NULL, self->sqes_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, self->fd, IORING_OFF_SQES);
+	if (self->sqes == MAP_FAILED)
+		goto unmap_ring;
+
+	self->sq_khead = ring + params.sq_off.head;
+	self->sq_ktail = ring + params.sq_off.tail;
+	self->sq_kflags = ring + params.sq_off.flags;
+	self->sq_mask = *(unsigned int *) (ring + params.sq_off.ring_mask);
+	self->sq_entries = params.sq_entries;
+	self->sq_tail = *self->sq_ktail;
+
+	self->cq_khead = ring + params.cq_off.head;
+	self->cq_ktail = ring + params.cq_off.tail;
+	self->cq_mask = *(unsigned int *) (ring + params.cq_off.ring_mask);
+	self->cqes = ring + params.cq_off.cqes;
+
+	/* SQEs are used in ring order, map them once */
+	array = ring + params.sq_off.array;
+	for (i=0; i<params.sq_entries; i++)
+		array[i] = i;
+
+	return self;
+
+unmap_ring:
+	munmap (ring, self->ring_size);
+close_fd:
+	close (self->fd);
+free_self:
+	hev_free (self);
+	return NULL;
+}
+
+void
+hev_task_io_uring_destroy (HevTaskIOUring *self)
+{
+	munmap (self->sqes, self->sqes_size);
+	munmap (self->ring, self->ring_size);
+	close (self->fd);
+	hev_free (self);
+}
+
+struct io_uring_sqe *
+hev_task_io_uring_get_sqe (HevTaskIOUring *self)
+{
+	unsigned int head;
+
+	head = __atomic_load_n (self->sq_khead, __ATOMIC_ACQUIRE);
+	while ((self->sq_tail - head) >= self->sq_entries) {
+		/* full, make room */
+		if (hev_task_io_uring_submit (self, 0) == -1 && errno != EBUSY)
+			return NULL;
+		head = __atomic_load_n (self->sq_khead, __ATOMIC_ACQUIRE);
+	}
+
+	self->sq_pending ++;
+	return &self->sqes[self->sq_tail ++ & self->sq_mask];
+}
+
+int
+hev_task_io_uring_watch (HevTaskIOUring *self, int fd)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = hev_task_io_uring_get_sqe (self);
+	if (!sqe)
+		return -1;
+
+	/* one shot, rearmed after reaped */
+	hev_task_io_uring_prep (sqe, IORING_OP_POLL_ADD, fd, NULL, 0, 0, NULL);
+	sqe->poll_events = POLLIN;
+
+	return 0;
+}
+
+int
+hev_task_io_uring_enter (HevTaskIOUring *self, int timeout)
+{
+	unsigned int flags;
+
+	if (timeout)
+		return hev_task_io_uring_submit (self, timeout);
+
+	/* completions are posted to ring, no syscall needed to reap */
+	flags = __atomic_load_n (self->sq_kflags, __ATOMIC_RELAXED);
+	if (self->sq_pending || (flags & IORING_SQ_CQ_OVERFLOW))
+		return hev_task_io_uring_submit (self, 0);
+
+	return 0;
+}
+
+unsigned int
+hev_task_io_uring_reap (HevTaskIOUring *self, struct io_uring_cqe *cqes,
+			unsigned int count)
+{
+	unsigned int head, tail, i;
+
+	head = *self->cq_khead;
+	tail = __atomic_load_n (self->cq_ktail, __ATOMIC_ACQUIRE);
+
+	for (i=0; i<count && head!=tail; i++, head++)
+		cqes[i] = self->cqes[head & self->cq_mask];
+
+	__atomic_store_n (self->cq_khead, head, __ATOMIC_RELEASE);
+
+	return i;
+}
+
+int
+hev_task_io_uring_wait (HevTaskIOUring *self, HevTaskIOUringOp *op)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+	HevTask *task = ctx->current_task;
+
+	op->task = task;
+
+	/* completed to ring of this task system, stay here until done */
+	task->pin_count ++;
+	task->io_uring_op = op;
+	while (!op->done) {
+		hev_task_yield (HEV_TASK_WAITIO);
+
+		/* interrupted to migrate, op is referenced by kernel until done */
+		if (!op->done && task->migrate_target && !op->cancelled)
+			hev_task_io_uring_cancel (self, op);
+	}
+	task->io_uring_op = NULL;
+	task->pin_count --;
+
+	return op->res;
+}
+
+static void
+hev_task_io_uring_cancel (HevTaskIOUring *self, HevTaskIOUringOp *op)
+{
+	struct io_uring_sqe *sqe;
+
+	/* ring is full, try again on next wakeup */
+	sqe = hev_task_io_uring_get_sqe (self);
+	if (!sqe)
+		return;
+
+	/* completes with -ECANCELED, unless it's done or about to be */
+	hev_task_io_uring_prep (sqe, IORING_OP_ASYNC_CANCEL, -1, op, 0, 0,
+				HEV_TASK_IO_URING_CANCEL);
+	op->cancelled = 1;
+}
+
+static int
+hev_task_io_uring_submit (HevTaskIOUring *self, int timeout)
+{
+	struct io_uring_getevents_arg arg = { 0 };
+	struct __kernel_timespec ts;
+	unsigned int flags = 0;
+	void *argp = NULL;
+	size_t argsz = 0;
+	int ret;
+
+	__atomic_store_n (self->sq_ktail, self->sq_tail, __ATOMIC_RELEASE);
+
+	if (timeout || (__atomic_load_n (self->sq_kflags, __ATOMIC_RELAXED) &
+					IORING_SQ_CQ_OVERFLOW))
+		flags |= IORING_ENTER_GETEVENTS;
+
+	/* until next timer expires */
+	if (timeout > 0) {
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000;
+		arg.ts = (uintptr_t) &ts;
+		argp = &arg;
+		argsz = sizeof (arg);
+		flags |= IORING_ENTER_EXT_ARG;
+	}
+
+	ret = syscall (__NR_io_uring_enter, self->fd, self->sq_pending,
+				timeout ? 1 : 0, flags, argp, argsz);
+	if (ret == -1)
+		return (errno == EINTR || errno == ETIME) ? 0 : -1;
+
+	self->sq_pending -= ret;
+	return ret;
+}
+
+#endif /* ENABLE_IO_URING */
+
@@ -0,0 +1,69 @@
+/*
+ ============================================================================
+ Name        : hev-task-io-uring.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Task I/O uring
+ ============================================================================
+ */
+
+#ifndef __HEV_TASK_IO_URING_H__
+#define __HEV_TASK_IO_URING_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <linux/io_uring.h>
+
+#include "hev-task.h"
+
+typedef struct _HevTaskIOUring HevTaskIOUring;
+typedef struct _HevTaskIOUringOp HevTaskIOUringOp;
+
+/* user data of an IORING_OP_ASYNC_CANCEL, its completion is ignored */
+#define HEV_TASK_IO_URING_CANCEL	((HevTaskIOUringOp *) 1)
+
+/*
+ * A submitted operation, user data of its SQE, 0 is the epoll fd watch.
+ * NOTE: must stay valid until done, the submitter waits for it.
+ */
+struct _HevTaskIOUringOp
+{
+	HevTask *task;
+	int res;
+	int done;
+	int cancelled;
+};
+
+HevTaskIOUring * hev_task_io_uring_new (unsigned int entries);
+void hev_task_io_uring_destroy (HevTaskIOUring *self);
+
+struct io_uring_sqe * hev_task_io_uring_get_sqe (HevTaskIOUring *self);
+int hev_task_io_uring_watch (HevTaskIOUring *self, int fd);
+
+/* submit prepared SQEs, and wait for one CQE at least, up to @timeout
+ * milliseconds if it's positive, forever if -1 */
+int hev_task_io_uring_enter (HevTaskIOUring *self, int timeout);
+unsigned int hev_task_io_uring_reap (HevTaskIOUring *self,
+			struct io_uring_cqe *cqes, unsigned int count);
+
+/* wait in current task until @op is done, returns its result. If the
+ * task is asked to migrate, @op is cancelled and may fail with
+ * -ECANCELED or -EINTR, check op->cancelled to submit it again */
+int hev_task_io_uring_wait (HevTaskIOUring *self, HevTaskIOUringOp *op);
+
+static inline void
+hev_task_io_uring_prep (struct io_uring_sqe *sqe, int opcode, int fd,
+			const void *addr, unsigned int len, uint64_t offset,
+			HevTaskIOUringOp *op)
+{
+	memset (sqe, 0, sizeof (*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t) addr;
+	sqe->len = len;
+	sqe->off = offset;
+	sqe->user_data = (uintptr_t) op;
+}
+
+#endif /* __HEV_TASK_IO_URING_H__ */
+
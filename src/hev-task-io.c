@@ -0,0 +1,261 @@
+/*
+ ============================================================================
+ Name        : hev-task-io.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Task I/O operations
+ ============================================================================
+ */
+
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "hev-task.h"
+#include "hev-task-io.h"
+#include "hev-task-private.h"
+#include "hev-task-system-private.h"
+
+#ifdef ENABLE_IO_URING
+# include "hev-task-io-uring.h"
+#endif
+
+/* as much as a read or write of Linux at a time */
+#define MAX_RW_COUNT	(0x7ffff000)
+
+static void hev_task_io_wait_ready (HevTask *task, int fd,
+			unsigned int events);
+static int hev_task_io_connect_finish (int fd);
+#ifdef ENABLE_IO_URING
+static HevTaskIOUring * hev_task_io_get_uring (void);
+static int hev_task_io_uring_run (int opcode, int fd, const void *addr,
+			unsigned int len, uint64_t offset, unsigned int events);
+#endif
+
+ssize_t
+hev_task_io_read (int fd, void *buf, size_t count)
+{
+	HevTask *task = hev_task_self ();
+	ssize_t size;
+#ifdef ENABLE_IO_URING
+	HevTaskIOUring *ring = hev_task_io_get_uring ();
+
+	if (ring) {
+		if (count > MAX_RW_COUNT)
+			count = MAX_RW_COUNT;
+		size = hev_task_io_uring_run (IORING_OP_READ, fd, buf, count,
+					-1, POLLIN);
+		if (size != -2)
+			return size;
+	}
+#endif
+
+retry:
+	hev_task_io_wait_ready (task, fd, EPOLLIN);
+	size = read (fd, buf, count);
+	if (size == -1 && errno == EAGAIN) {
+		hev_task_clear_fd_ready (task, fd, EPOLLIN);
+		hev_task_yield (HEV_TASK_WAITIO);
+		goto retry;
+	}
+
+	return size;
+}
+
+ssize_t
+hev_task_io_write (int fd, const void *buf, size_t count)
+{
+	HevTask *task = hev_task_self ();
+	ssize_t size;
+#ifdef ENABLE_IO_URING
+	HevTaskIOUring *ring = hev_task_io_get_uring ();
+
+	if (ring) {
+		if (count > MAX_RW_COUNT)
+			count = MAX_RW_COUNT;
+		size = hev_task_io_uring_run (IORING_OP_WRITE, fd, buf, count,
+					-1, POLLOUT);
+		if (size != -2)
+			return size;
+	}
+#endif
+
+retry:
+	hev_task_io_wait_ready (task, fd, EPOLLOUT);
+	size = write (fd, buf, count);
+	if (size == -1 && errno == EAGAIN) {
+		hev_task_clear_fd_ready (task, fd, EPOLLOUT);
+		hev_task_yield (HEV_TASK_WAITIO);
+		goto retry;
+	}
+
+	return size;
+}
+
+int
+hev_task_io_accept (int fd, struct sockaddr *addr, socklen_t *addr_len)
+{
+	HevTask *task = hev_task_self ();
+	int new_fd;
+#ifdef ENABLE_IO_URING
+	HevTaskIOUring *ring = hev_task_io_get_uring ();
+
+	/* NOTE: offset is addr2, the pointer to length of address */
+	if (ring) {
+		new_fd = hev_task_io_uring_run (IORING_OP_ACCEPT, fd, addr, 0,
+					(uintptr_t) addr_len, POLLIN);
+		if (new_fd != -2)
+			return new_fd;
+	}
+#endif
+
+retry:
+	hev_task_io_wait_ready (task, fd, EPOLLIN);
+	new_fd = accept (fd, addr, addr_len);
+	if (new_fd == -1 && errno == EAGAIN) {
+		hev_task_clear_fd_ready (task, fd, EPOLLIN);
+		hev_task_yield (HEV_TASK_WAITIO);
+		goto retry;
+	}
+
+	return new_fd;
+}
+
+int
+hev_task_io_connect (int fd, const struct sockaddr *addr, socklen_t addr_len)
+{
+	HevTask *task = hev_task_self ();
+	int ret;
+#ifdef ENABLE_IO_URING
+	HevTaskIOUring *ring = hev_task_io_get_uring ();
+
+	if (ring) {
+		/* offset is length of address */
+		ret = hev_task_io_uring_run (IORING_OP_CONNECT, fd, addr, 0,
+					addr_len, 0);
+		if (ret != -1 || errno != EINPROGRESS)
+			return ret;
+
+		/* non-blocking socket, wait until writable */
+		ret = hev_task_io_uring_run (IORING_OP_POLL_ADD, fd, NULL,
+					0, 0, POLLOUT);
+		if (ret == -1)
+			return -1;
+		if (ret != -2)
+			return hev_task_io_connect_finish (fd);
+		goto wait;
+	}
+#endif
+
+	ret = connect (fd, addr, addr_len);
+	if (ret == 0 || errno != EINPROGRESS)
+		return ret;
+
+#ifdef ENABLE_IO_URING
+wait:
+#endif
+	/* writable when connected */
+	for (;;) {
+		struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+
+		hev_task_clear_fd_ready (task, fd, EPOLLOUT);
+		hev_task_yield (HEV_TASK_WAITIO);
+		hev_task_io_wait_ready (task, fd, EPOLLOUT);
+		if (poll (&pfd, 1, 0) > 0)
+			break;
+	}
+
+	return hev_task_io_connect_finish (fd);
+}
+
+static void
+hev_task_io_wait_ready (HevTask *task, int fd, unsigned int events)
+{
+	/* woken by other fds of task, skip the syscall */
+	while (!hev_task_get_fd_ready (task, fd, events))
+		hev_task_yield (HEV_TASK_WAITIO);
+}
+
+static int
+hev_task_io_connect_finish (int fd)
+{
+	socklen_t len = sizeof (int);
+	int error;
+
+	if (getsockopt (fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1)
+		return -1;
+	if (error) {
+		errno = error;
+		return -1;
+	}
+
+	return 0;
+}
+
+#ifdef ENABLE_IO_URING
+static HevTaskIOUring *
+hev_task_io_get_uring (void)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+
+	/* shared stack is reused while switched out, buffers must stay */
+	if (!ctx->current_task->stack)
+		return NULL;
+
+	return ctx->io_uring;
+}
+
+static int
+hev_task_io_uring_run (int opcode, int fd, const void *addr, unsigned int len,
+			uint64_t offset, unsigned int events)
+{
+	for (;;) {
+		HevTaskIOUringOp op = { 0 };
+		struct io_uring_sqe *sqe;
+		HevTaskIOUring *ring;
+		int res;
+
+		/* NOTE: ring of the task system that task is running on, moved
+		 * to one without ring, continue with I/O poll of the caller */
+		ring = hev_task_io_get_uring ();
+		if (!ring)
+			return -2;
+
+		sqe = hev_task_io_uring_get_sqe (ring);
+		if (!sqe)
+			return -1;
+
+		hev_task_io_uring_prep (sqe, opcode, fd, addr, len, offset, &op);
+		if (opcode == IORING_OP_POLL_ADD)
+			sqe->poll_events = events;
+
+		res = hev_task_io_uring_wait (ring, &op);
+		if (res >= 0)
+			return res;
+
+		/* cancelled to migrate, move and submit it again there */
+		if (op.cancelled && (res == -ECANCELED || res == -EINTR)) {
+			hev_task_yield (HEV_TASK_YIELD);
+			/* in progress, wait until writable like non-blocking one */
+			if (opcode == IORING_OP_CONNECT) {
+				errno = EINPROGRESS;
+				return -1;
+			}
+			continue;
+		}
+
+		/* non-blocking fd not ready, poll it and retry */
+		if (res == -EAGAIN && opcode != IORING_OP_POLL_ADD) {
+			if (hev_task_io_uring_run (IORING_OP_POLL_ADD, fd, NULL,
+							0, 0, events) == -1)
+				return -1;
+			continue;
+		}
+
+		errno = -res;
+		return -1;
+	}
+}
+#endif
+
@@ -0,0 +1,81 @@
+/*
+ ============================================================================
+ Name        : hev-task-io.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Task I/O operations
+ ============================================================================
+ */
+
+#ifndef __HEV_TASK_IO_H__
+#define __HEV_TASK_IO_H__
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/**
+ * hev_task_io_read:
+ * @fd: a file descriptor
+ * @buf: buffer to read into
+ * @count: maximum number of bytes to read
+ *
+ * Reads from @fd, as with the read() system call, but not block current
+ * thread. With the io_uring backend, the read is submitted to kernel and
+ * current task waits for its completion. Otherwise, @fd must be
+ * non-blocking and added to current task by hev_task_add_fd().
+ *
+ * Returns: the number of bytes read, or -1 on error and errno is set.
+ *
+ * Since: 1.6
+ */
+ssize_t hev_task_io_read (int fd, void *buf, size_t count);
+
+/**
+ * hev_task_io_write:
+ * @fd: a file descriptor
+ * @buf: buffer to write from
+ * @count: maximum number of bytes to write
+ *
+ * Writes to @fd, as with the write() system call, but not block current
+ * thread. See hev_task_io_read() for the requirements on @fd.
+ *
+ * Returns: the number of bytes written, or -1 on error and errno is set.
+ *
+ * Since: 1.6
+ */
+ssize_t hev_task_io_write (int fd, const void *buf, size_t count);
+
+/**
+ * hev_task_io_accept:
+ * @fd: a listening socket
+ * @addr: (nullable): address of the peer
+ * @addr_len: (nullable): size of @addr, replaced by the size of address
+ *
+ * Accepts a connection on @fd, as with the accept() system call, but not
+ * block current thread. See hev_task_io_read() for the requirements on @fd.
+ *
+ * Returns: the file descriptor of accepted socket, or -1 on error and
+ * errno is set.
+ *
+ * Since: 1.6
+ */
+int hev_task_io_accept (int fd, struct sockaddr *addr, socklen_t *addr_len);
+
+/**
+ * hev_task_io_connect:
+ * @fd: a socket
+ * @addr: address to connect to
+ * @addr_len: size of @addr
+ *
+ * Connects @fd to @addr, as with the connect() system call, but not block
+ * current thread. See hev_task_io_read() for the requirements on @fd.
+ *
+ * Returns: 0 on success, or -1 on error and errno is set.
+ *
+ * Since: 1.6
+ */
+int hev_task_io_connect (int fd, const struct sockaddr *addr,
+			socklen_t addr_len);
+
+#endif /* __HEV_TASK_IO_H__ */
+
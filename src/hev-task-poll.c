@@ -9,41 +9,140 @@
 
 #include "hev-task-poll.h"
 #include "hev-task.h"
+#include "hev-task-private.h"
+#include "hev-task-clock.h"
+
+static int hev_task_poll_watch (HevTask *task, HevTaskPollFD *fd);
+static void hev_task_poll_unwatch (HevTask *task, HevTaskPollFD *fd);
+static int hev_task_poll_get_ready (HevTask *task, HevTaskPollFD fds[],
+			unsigned int nfds);
 
 int
 hev_task_poll (HevTaskPollFD fds[], unsigned int nfds, int timeout)
 {
 	HevTask *task = hev_task_self ();
-	int i, ret;
+	uint64_t end = 0;
+	unsigned int i, j;
+	int ret;
 
 	ret = poll (fds, nfds, 0);
-	if ((ret > 0) || (timeout == 0))
+	if ((ret != 0) || (timeout == 0))
 		return ret;
 
-	for (i=0; i<nfds; i++)
-		hev_task_add_fd (task, fds[i].fd, fds[i].events);
+	for (i=0; i<nfds; i++) {
+		if (hev_task_poll_watch (task, &fds[i]) == -1) {
+			ret = -1;
+			goto unwatch;
+		}
+	}
 
-	if (timeout > 0) {
-retry_sleep:
-		timeout = hev_task_sleep (timeout);
-		ret = poll (fds, nfds, 0);
-		if (timeout > 0 && ret == 0)
-			goto retry_sleep;
+	/* readiness is delivered by I/O poll, no poll() again */
+	if (timeout > 0)
+		end = hev_task_clock_time () + (uint64_t) timeout * 1000;
+	for (;;) {
+		int left = -1;
 
-		goto quit;
-	}
+		if (timeout > 0) {
+			uint64_t now = hev_task_clock_time ();
 
-retry:
-	ret = poll (fds, nfds, 0);
-	if (ret == 0) {
-		hev_task_yield (HEV_TASK_WAITIO);
-		goto retry;
+			if (now >= end)
+				break;
+			left = (end - now + 999) / 1000;
+		}
+		hev_task_wait_io_timeout (left);
+
+		ret = hev_task_poll_get_ready (task, fds, nfds);
+		if (ret)
+			break;
 	}
 
-quit:
-	for (i=0; i<nfds; i++)
-		hev_task_del_fd (task, fds[i].fd);
+unwatch:
+	for (j=0; j<i; j++)
+		hev_task_poll_unwatch (task, &fds[j]);
 
 	return ret;
 }
 
+static int
+hev_task_poll_watch (HevTask *task, HevTaskPollFD *fd)
+{
+	HevTaskFD *task_fd;
+	unsigned int events, polled;
+
+	if (fd->fd < 0)
+		return 0;
+
+	/* added by the caller with the events: nothing to do, no syscall */
+	events = fd->events;
+	polled = events;
+	task_fd = hev_task_find_fd (task, fd->fd);
+	if (task_fd) {
+		polled = task_fd->polled | (events & ~task_fd->events);
+		if (polled == task_fd->polled)
+			goto clear;
+		events |= task_fd->events;
+	}
+
+	if (hev_task_add_fd (task, fd->fd, events) == -1)
+		return -1;
+
+	/* removed on return, the caller may close the fd then */
+	task_fd = hev_task_find_fd (task, fd->fd);
+	task_fd->polled = polled;
+
+clear:
+	/* not ready, poll() says */
+	task_fd->ready &= ~(fd->events | POLLERR | POLLHUP);
+
+	return 0;
+}
+
+static void
+hev_task_poll_unwatch (HevTask *task, HevTaskPollFD *fd)
+{
+	HevTaskFD *task_fd;
+	unsigned int events;
+
+	if (fd->fd < 0)
+		return;
+
+	/* listed twice, or added by the caller */
+	task_fd = hev_task_find_fd (task, fd->fd);
+	if (!task_fd || !task_fd->polled)
+		return;
+
+	/* back to the events of the caller, errors of closed fds are fine */
+	events = task_fd->events & ~task_fd->polled;
+	if (events)
+		hev_task_mod_fd (task, fd->fd, events);
+	else
+		hev_task_del_fd (task, fd->fd);
+}
+
+static int
+hev_task_poll_get_ready (HevTask *task, HevTaskPollFD fds[], unsigned int nfds)
+{
+	unsigned int i;
+	int count = 0;
+
+	for (i=0; i<nfds; i++) {
+		HevTaskFD *task_fd;
+
+		fds[i].revents = 0;
+		if (fds[i].fd < 0)
+			continue;
+
+		/* closed, dropped when moved to another worker */
+		task_fd = hev_task_find_fd (task, fds[i].fd);
+		if (task_fd)
+			fds[i].revents = task_fd->ready &
+				(fds[i].events | POLLERR | POLLHUP);
+		else
+			fds[i].revents = POLLNVAL;
+		if (fds[i].revents)
+			count ++;
+	}
+
+	return count;
+}
+
@@ -22,6 +22,11 @@ typedef struct pollfd HevTaskPollFD;
  *
  * Polls @fds, as with the poll() system call, but not block current thread.
  *
+ * File descriptors already added to current task with the events, see
+ * hev_task_add_fd(), are polled without a syscall. The others are added
+ * while waiting and removed before return. Readiness is taken from the
+ * I/O events of task system while waiting.
+ *
  * Returns: the number of entries in @fds whose %revents fields
  * were filled in, or 0 if the operation timed out, or -1 on error or
  * if the call was interrupted.
@@ -10,40 +10,107 @@
 #ifndef __HEV_TASK_PRIVATE_H__
 #define __HEV_TASK_PRIVATE_H__
 
-#include <setjmp.h>
+#include <stdint.h>
 
 #include "hev-task.h"
+#include "hev-task-context.h"
+#include "hev-task-timer-manager.h"
 
 typedef struct _HevTaskSchedEntity HevTaskSchedEntity;
+typedef struct _HevTaskFD HevTaskFD;
 
 struct _HevTaskSchedEntity
 {
+	/* absolute, in microseconds, 0: no deadline */
+	uint64_t deadline;
+
+	/* weighted-fair policy only */
+	uint64_t vruntime;
+	unsigned int index;
+};
+
+/* a fd added to task, waiter of fd watcher of task system */
+struct _HevTaskFD
+{
+	HevTaskFD *next;
 	HevTask *task;
+
+	struct _HevTaskFDWatcher *watcher;
+	HevTaskFD *watcher_next;
+
+	int fd;
+	unsigned int events;
+	unsigned int ready; /* cached, set by I/O poll, cleared on EAGAIN */
+	unsigned int polled; /* events added by hev_task_poll, until return */
 };
 
+#define HEV_TASK_ALIGN	(64) /* cache line size */
+
+/*
+ * Layout: run queue operations touch only the hot header, which fills
+ * the first cache line (tasks are always allocated on a cache line
+ * boundary). Fields used only at creation or exit are moved to the tail.
+ */
 struct _HevTask
 {
-	void *stack_top;
-	HevTaskEntry entry;
-	void *data;
+	/* hot */
+	void *stack_top; /* NOTE: first member, used by hev_task_execute */
 
 	HevTask *prev;
 	HevTask *next;
 
+	int priority;
+	int next_priority;
+	HevTaskState state;
+
 	HevTaskSchedEntity sched_entity;
 
+	/* switch */
+	HevTaskContext context;
 	void *stack;
-
 	int ref_count;
-	int priority;
-	int next_priority;
+
+	/* cold */
+	HevTaskEntry entry;
+	void *data;
+
 	int stack_size;
-	HevTaskState state;
 
-	jmp_buf context;
-};
+	/* fds in I/O poll, moved along with task between workers */
+	HevTaskFD *fds;
+	/* pending io_uring op, pins task to ring of its system */
+	struct _HevTaskIOUringOp *io_uring_op;
+
+	/* sleep, in timing wheel of owner */
+	HevTaskTimer timer;
+
+	/* workers only */
+	struct _HevTaskSystemContext *owner;
+	HevTask *wake_next;
+	int wake_pending;
+	struct _HevTaskSystemContext *migrate_target;
+	int pin_count; /* not movable, e.g. sleeping in timing wheel of its system */
+
+	/* shared stack only */
+	void *stack_bottom;
+	void *saved_stack;
+	size_t saved_stack_size;
+
+	/* heap allocated only, unaligned address to free */
+	void *mem;
+} __attribute__ ((aligned (HEV_TASK_ALIGN)));
+
+_Static_assert (__builtin_offsetof (HevTask, context) <= HEV_TASK_ALIGN,
+			"hot header of HevTask must fit in a cache line");
 
 extern void hev_task_execute (HevTask *self, void *executer);
 
+void hev_task_destroy (HevTask *self);
+
+void hev_task_attach_fds (HevTask *self, struct _HevTaskSystemContext *ctx);
+void hev_task_detach_fds (HevTask *self, struct _HevTaskSystemContext *ctx);
+void hev_task_free_fds (HevTask *self);
+HevTaskFD * hev_task_find_fd (HevTask *self, int fd);
+
 #endif /* __HEV_TASK_PRIVATE_H__ */
 
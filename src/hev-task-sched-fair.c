@@ -0,0 +1,264 @@
+/*
+ ============================================================================
+ Name        : hev-task-sched-fair.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Task scheduling policy, weighted-fair
+ ============================================================================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hev-task-sched.h"
+#include "hev-task-clock.h"
+#include "hev-memory-allocator.h"
+
+#define HEAP_INIT_SIZE	(64)
+#define WAKEUP_CREDIT	(3000) /* us */
+
+typedef struct _HevTaskSchedFair HevTaskSchedFair;
+typedef struct _HevTaskSchedFairNode HevTaskSchedFairNode;
+
+/* key is kept in heap, sifting doesn't touch tasks but moved ones */
+struct _HevTaskSchedFairNode
+{
+	uint64_t vruntime;
+	HevTask *task;
+};
+
+struct _HevTaskSchedFair
+{
+	HevTaskSchedFairNode *heap;
+	unsigned int size;
+	unsigned int alloc;
+
+	uint64_t min_vruntime;
+	uint64_t exec_start;
+	uint64_t wakeup_credit;
+};
+
+static int hev_task_sched_fair_init (HevTaskSystemContext *ctx);
+static void hev_task_sched_fair_fini (HevTaskSystemContext *ctx);
+static void hev_task_sched_fair_enqueue (HevTaskSystemContext *ctx,
+			HevTask *task, int flags);
+static void hev_task_sched_fair_dequeue (HevTaskSystemContext *ctx,
+			HevTask *task);
+static void hev_task_sched_fair_requeue (HevTaskSystemContext *ctx,
+			HevTask *task);
+static HevTask * hev_task_sched_fair_pick (HevTaskSystemContext *ctx);
+static HevTask * hev_task_sched_fair_iterate (HevTaskSystemContext *ctx,
+			HevTask *task);
+
+/*
+ * Each task accounts its run time in virtual runtime, scaled by its weight,
+ * and the ready task with the smallest one runs next. The weight doubles
+ * every 1/8 of priority levels, higher priority gets more CPU time, but
+ * lower ones never starve. Waking tasks are credited a little for the
+ * time they waited, new and moved-in tasks start at the current minimum.
+ */
+const HevTaskSchedOps hev_task_sched_fair =
+{
+	.init = hev_task_sched_fair_init,
+	.fini = hev_task_sched_fair_fini,
+	.enqueue = hev_task_sched_fair_enqueue,
+	.dequeue = hev_task_sched_fair_dequeue,
+	.requeue = hev_task_sched_fair_requeue,
+	.pick = hev_task_sched_fair_pick,
+	.iterate = hev_task_sched_fair_iterate,
+};
+
+static int
+hev_task_sched_fair_init (HevTaskSystemContext *ctx)
+{
+	HevTaskSchedFair *self;
+
+	self = hev_malloc0 (sizeof (HevTaskSchedFair));
+	if (!self)
+		return -1;
+
+	self->heap = hev_malloc (sizeof (HevTaskSchedFairNode) * HEAP_INIT_SIZE);
+	if (!self->heap) {
+		hev_free (self);
+		return -1;
+	}
+
+	self->alloc = HEAP_INIT_SIZE;
+	self->wakeup_credit = (uint64_t) WAKEUP_CREDIT *
+		hev_task_clock_cycles_per_usec ();
+	ctx->sched_data = self;
+
+	return 0;
+}
+
+static void
+hev_task_sched_fair_fini (HevTaskSystemContext *ctx)
+{
+	HevTaskSchedFair *self = ctx->sched_data;
+
+	hev_free (self->heap);
+	hev_free (self);
+	ctx->sched_data = NULL;
+}
+
+static inline void
+hev_task_sched_fair_set_node (HevTaskSchedFair *self, unsigned int index,
+			HevTaskSchedFairNode *node)
+{
+	self->heap[index] = *node;
+	node->task->sched_entity.index = index;
+}
+
+static void
+hev_task_sched_fair_sift_up (HevTaskSchedFair *self, unsigned int index)
+{
+	HevTaskSchedFairNode node = self->heap[index];
+
+	while (index) {
+		unsigned int parent = (index - 1) / 2;
+
+		if (self->heap[parent].vruntime <= node.vruntime)
+			break;
+		hev_task_sched_fair_set_node (self, index, &self->heap[parent]);
+		index = parent;
+	}
+
+	hev_task_sched_fair_set_node (self, index, &node);
+}
+
+static void
+hev_task_sched_fair_sift_down (HevTaskSchedFair *self, unsigned int index)
+{
+	HevTaskSchedFairNode node = self->heap[index];
+
+	for (;;) {
+		unsigned int child = index * 2 + 1;
+
+		if (child >= self->size)
+			break;
+		if ((child + 1) < self->size &&
+				self->heap[child + 1].vruntime < self->heap[child].vruntime)
+			child ++;
+		if (node.vruntime <= self->heap[child].vruntime)
+			break;
+		hev_task_sched_fair_set_node (self, index, &self->heap[child]);
+		index = child;
+	}
+
+	hev_task_sched_fair_set_node (self, index, &node);
+}
+
+static inline void
+hev_task_sched_fair_update_current (HevTaskSchedFair *self, HevTask *task)
+{
+	uint64_t now = hev_task_clock_cycles ();
+	unsigned int shift;
+
+	/* weight = 2^-shift, highest priority is the heaviest */
+	shift = (task->priority - HEV_TASK_PRIORITY_MIN) * 8 / PRIORITY_COUNT;
+	task->sched_entity.vruntime += (now - self->exec_start) << shift;
+	self->exec_start = now;
+}
+
+static void
+hev_task_sched_fair_enqueue (HevTaskSystemContext *ctx, HevTask *task,
+			int flags)
+{
+	HevTaskSchedFair *self = ctx->sched_data;
+	HevTaskSchedFairNode node;
+
+	if (self->size == self->alloc) {
+		HevTaskSchedFairNode *heap;
+
+		heap = hev_malloc (sizeof (HevTaskSchedFairNode) * self->alloc * 2);
+		if (!heap)
+			abort ();
+		memcpy (heap, self->heap, sizeof (HevTaskSchedFairNode) * self->size);
+		hev_free (self->heap);
+		self->heap = heap;
+		self->alloc *= 2;
+	}
+
+	task->priority = task->next_priority;
+
+	if (flags & HEV_TASK_SCHED_NEW) {
+		/* vruntime of other systems means nothing here */
+		task->sched_entity.vruntime = self->min_vruntime;
+	} else if (flags & HEV_TASK_SCHED_WAKEUP) {
+		uint64_t vruntime = 0;
+
+		if (self->min_vruntime > self->wakeup_credit)
+			vruntime = self->min_vruntime - self->wakeup_credit;
+		if (task->sched_entity.vruntime < vruntime)
+			task->sched_entity.vruntime = vruntime;
+	}
+
+	node.vruntime = task->sched_entity.vruntime;
+	node.task = task;
+	self->heap[self->size] = node;
+	hev_task_sched_fair_sift_up (self, self->size ++);
+}
+
+static void
+hev_task_sched_fair_dequeue (HevTaskSystemContext *ctx, HevTask *task)
+{
+	HevTaskSchedFair *self = ctx->sched_data;
+	unsigned int index = task->sched_entity.index;
+
+	/* keep for the next wakeup */
+	if (task == ctx->current_task)
+		hev_task_sched_fair_update_current (self, task);
+
+	self->size --;
+	if (index == self->size)
+		return;
+
+	/* move the last one to the hole */
+	self->heap[index] = self->heap[self->size];
+	if (index && self->heap[(index - 1) / 2].vruntime > self->heap[index].vruntime)
+		hev_task_sched_fair_sift_up (self, index);
+	else
+		hev_task_sched_fair_sift_down (self, index);
+}
+
+static void
+hev_task_sched_fair_requeue (HevTaskSystemContext *ctx, HevTask *task)
+{
+	HevTaskSchedFair *self = ctx->sched_data;
+	unsigned int index = task->sched_entity.index;
+
+	hev_task_sched_fair_update_current (self, task);
+	task->priority = task->next_priority;
+
+	/* only increased */
+	self->heap[index].vruntime = task->sched_entity.vruntime;
+	hev_task_sched_fair_sift_down (self, index);
+}
+
+static HevTask *
+hev_task_sched_fair_pick (HevTaskSystemContext *ctx)
+{
+	HevTaskSchedFair *self = ctx->sched_data;
+
+	if (self->min_vruntime < self->heap[0].vruntime)
+		self->min_vruntime = self->heap[0].vruntime;
+	self->exec_start = hev_task_clock_cycles ();
+
+	return self->heap[0].task;
+}
+
+static HevTask *
+hev_task_sched_fair_iterate (HevTaskSystemContext *ctx, HevTask *task)
+{
+	HevTaskSchedFair *self = ctx->sched_data;
+	unsigned int index = self->size;
+
+	/* leaves first, the larger vruntime ones */
+	if (task)
+		index = task->sched_entity.index;
+	if (!index)
+		return NULL;
+
+	return self->heap[index - 1].task;
+}
+
@@ -0,0 +1,37 @@
+/*
+ ============================================================================
+ Name        : hev-task-sched-priority.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Task scheduling policy, strict priority
+ ============================================================================
+ */
+
+#include "hev-task-sched-priority.h"
+
+static int hev_task_sched_priority_init (HevTaskSystemContext *ctx);
+static void hev_task_sched_priority_fini (HevTaskSystemContext *ctx);
+
+const HevTaskSchedOps hev_task_sched_priority =
+{
+	.init = hev_task_sched_priority_init,
+	.fini = hev_task_sched_priority_fini,
+	.enqueue = hev_task_sched_priority_enqueue,
+	.dequeue = hev_task_sched_priority_dequeue,
+	.requeue = hev_task_sched_priority_requeue,
+	.pick = hev_task_sched_priority_pick,
+	.iterate = hev_task_sched_priority_iterate,
+};
+
+static int
+hev_task_sched_priority_init (HevTaskSystemContext *ctx)
+{
+	/* lists are in context, empty */
+	return 0;
+}
+
+static void
+hev_task_sched_priority_fini (HevTaskSystemContext *ctx)
+{
+}
+
@@ -0,0 +1,132 @@
+/*
+ ============================================================================
+ Name        : hev-task-sched-priority.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Task scheduling policy, strict priority
+ ============================================================================
+ */
+
+#ifndef __HEV_TASK_SCHED_PRIORITY_H__
+#define __HEV_TASK_SCHED_PRIORITY_H__
+
+#include "hev-task-sched.h"
+
+/*
+ * A FIFO list per priority, round-robin within the highest non-empty one.
+ * Lower priorities run only when all higher ones are waiting. Inlined in
+ * the scheduler, it's the default.
+ */
+
+#define HEV_TASK_SCHED_CALL(ctx, op, ...) \
+	(((ctx)->sched_ops == &hev_task_sched_priority) ? \
+	 hev_task_sched_priority_##op (ctx, ##__VA_ARGS__) : \
+	 (ctx)->sched_ops->op (ctx, ##__VA_ARGS__))
+
+static inline void
+hev_task_sched_priority_enqueue (HevTaskSystemContext *ctx, HevTask *task,
+			int flags)
+{
+	HevTask **running_tasks;
+	HevTask **running_tasks_tail;
+
+	task->priority = task->next_priority;
+
+	running_tasks = &ctx->running_tasks[task->priority];
+	running_tasks_tail = &ctx->running_tasks_tail[task->priority];
+
+	task->next = NULL;
+	if (*running_tasks_tail) {
+		task->prev = *running_tasks_tail;
+		(*running_tasks_tail)->next = task;
+	} else {
+		task->prev = NULL;
+	}
+	ctx->running_tasks_bitmap |= (1U << task->priority);
+
+	if (!*running_tasks)
+		*running_tasks = task;
+
+	*running_tasks_tail = task;
+}
+
+static inline void
+hev_task_sched_priority_dequeue (HevTaskSystemContext *ctx, HevTask *task)
+{
+	HevTask **running_tasks = &ctx->running_tasks[task->priority];
+	HevTask **running_tasks_tail = &ctx->running_tasks_tail[task->priority];
+
+	if (task->prev)
+		task->prev->next = task->next;
+	else
+		*running_tasks = task->next;
+
+	if (task->next)
+		task->next->prev = task->prev;
+	else
+		*running_tasks_tail = task->prev;
+
+	if (!*running_tasks)
+		ctx->running_tasks_bitmap ^= (1U << task->priority);
+}
+
+static inline void
+hev_task_sched_priority_requeue (HevTaskSystemContext *ctx, HevTask *task)
+{
+	HevTask **running_tasks;
+	HevTask **running_tasks_tail;
+
+	/* current task is the head of its list, unless it has just moved in
+	 * from the deadline list */
+	if (task->priority == task->next_priority && !task->prev) {
+		if (!task->next)
+			return;
+
+		running_tasks = &ctx->running_tasks[task->priority];
+		running_tasks_tail = &ctx->running_tasks_tail[task->priority];
+
+		*running_tasks = task->next;
+
+		task->next = NULL;
+		task->prev = *running_tasks_tail;
+
+		(*running_tasks)->prev = NULL;
+		(*running_tasks_tail)->next = task;
+		*running_tasks_tail = task;
+		return;
+	}
+
+	/* priority changed */
+	hev_task_sched_priority_dequeue (ctx, task);
+	hev_task_sched_priority_enqueue (ctx, task, 0);
+}
+
+static inline HevTask *
+hev_task_sched_priority_pick (HevTaskSystemContext *ctx)
+{
+	/* highest priority is the lowest bit set, bitmap is not empty here */
+	return ctx->running_tasks[__builtin_ctz (ctx->running_tasks_bitmap)];
+}
+
+static inline HevTask *
+hev_task_sched_priority_iterate (HevTaskSystemContext *ctx, HevTask *task)
+{
+	int priority = PRIORITY_MAX;
+
+	/* lowest priority and latest appended first */
+	if (task) {
+		if (task->prev)
+			return task->prev;
+		priority = task->priority - 1;
+	}
+
+	for (; priority>=HEV_TASK_PRIORITY_MIN; priority--) {
+		if (ctx->running_tasks_tail[priority])
+			return ctx->running_tasks_tail[priority];
+	}
+
+	return NULL;
+}
+
+#endif /* __HEV_TASK_SCHED_PRIORITY_H__ */
+
@@ -0,0 +1,45 @@
+/*
+ ============================================================================
+ Name        : hev-task-sched.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Task scheduling policy
+ ============================================================================
+ */
+
+#ifndef __HEV_TASK_SCHED_H__
+#define __HEV_TASK_SCHED_H__
+
+#include "hev-task-system-private.h"
+
+/* enqueue flags */
+#define HEV_TASK_SCHED_WAKEUP	(1 << 0) /* woken up from waiting */
+#define HEV_TASK_SCHED_NEW	(1 << 1) /* new, or moved from another system */
+
+/*
+ * Ready tasks of a task system are kept by its policy, the current task
+ * stays in until it waits or exits. The scheduler keeps task state and
+ * ready count, the policy only orders tasks.
+ */
+struct _HevTaskSchedOps
+{
+	int (*init) (HevTaskSystemContext *ctx);
+	void (*fini) (HevTaskSystemContext *ctx);
+
+	/* task becomes ready */
+	void (*enqueue) (HevTaskSystemContext *ctx, HevTask *task, int flags);
+	/* ready task leaves, current task or moved to another system */
+	void (*dequeue) (HevTaskSystemContext *ctx, HevTask *task);
+	/* current task yields and stays ready */
+	void (*requeue) (HevTaskSystemContext *ctx, HevTask *task);
+	/* next task to run, there is at least one ready task */
+	HevTask * (*pick) (HevTaskSystemContext *ctx);
+	/* iterate ready tasks, least urgent first, start with NULL */
+	HevTask * (*iterate) (HevTaskSystemContext *ctx, HevTask *task);
+};
+
+extern const HevTaskSchedOps hev_task_sched_priority;
+extern const HevTaskSchedOps hev_task_sched_fair;
+
+#endif /* __HEV_TASK_SCHED_H__ */
+
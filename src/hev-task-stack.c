@@ -0,0 +1,214 @@
+/*
+ ============================================================================
+ Name        : hev-task-stack.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Task stack
+ ============================================================================
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "hev-task-stack.h"
+#include "hev-memory-allocator.h"
+
+#define STACK_OVERFLOW_DETECTION_TAG	(0xdeadbeefu)
+
+/* size classes: 16 KiB, 64 KiB, 256 KiB, 1 MiB */
+#define STACK_CLASS_SHIFT	(14)
+#define STACK_CLASS_COUNT	(4)
+#define MAX_CACHED_STACK_SIZE	CONFIG_TASK_STACK_CACHE_MAX_SIZE
+
+#define ALIGN_UP(addr, align) \
+	((addr + (typeof (addr)) align - 1) & ~((typeof (addr)) align - 1))
+
+typedef struct _HevTaskStackNode HevTaskStackNode;
+
+struct _HevTaskStackNode
+{
+	HevTaskStackNode *next;
+};
+
+struct _HevTaskStackPool
+{
+	HevTaskStackNode *cached_stacks[STACK_CLASS_COUNT];
+
+	size_t cached_size;
+};
+
+static int hev_task_stack_class (size_t size);
+
+#ifdef ENABLE_MMAP_STACK
+
+#ifndef MAP_STACK
+# define MAP_STACK	0
+#endif
+
+static size_t page_size;
+
+/*
+ * Layout: [guard page][stack ...]
+ * The guard page is PROT_NONE, so a stack overflow traps immediately.
+ * Stack pages are committed by the kernel on first touch.
+ */
+void *
+hev_task_stack_alloc (size_t size)
+{
+	void *region;
+	int flags;
+
+	if (!page_size)
+		page_size = sysconf (_SC_PAGESIZE);
+
+	size = ALIGN_UP (size, page_size) + page_size;
+	flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK;
+	region = mmap (NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (region == MAP_FAILED)
+		return NULL;
+
+	if (mprotect (region, page_size, PROT_NONE) == -1) {
+		munmap (region, size);
+		return NULL;
+	}
+
+	return region + page_size;
+}
+
+void
+hev_task_stack_free (void *stack, size_t size)
+{
+	size = ALIGN_UP (size, page_size) + page_size;
+	munmap (stack - page_size, size);
+}
+
+#else /* ENABLE_MMAP_STACK */
+
+void *
+hev_task_stack_alloc (size_t size)
+{
+	void *stack;
+
+	stack = malloc (size);
+	if (!stack)
+		return NULL;
+
+#ifdef ENABLE_STACK_OVERFLOW_DETECTION
+	*(unsigned int *) stack = STACK_OVERFLOW_DETECTION_TAG;
+#endif
+
+	return stack;
+}
+
+void
+hev_task_stack_free (void *stack, size_t size)
+{
+#ifdef ENABLE_STACK_OVERFLOW_DETECTION
+	assert (*(unsigned int *) stack == STACK_OVERFLOW_DETECTION_TAG);
+#endif
+	free (stack);
+}
+
+#endif /* !ENABLE_MMAP_STACK */
+
+HevTaskStackPool *
+hev_task_stack_pool_new (void)
+{
+	HevTaskStackPool *self;
+
+	self = hev_malloc0 (sizeof (HevTaskStackPool));
+	if (!self)
+		return NULL;
+
+	return self;
+}
+
+void
+hev_task_stack_pool_destroy (HevTaskStackPool *self)
+{
+	hev_task_stack_pool_trim (self);
+	hev_free (self);
+}
+
+void *
+hev_task_stack_pool_alloc (HevTaskStackPool *self, size_t *size)
+{
+	HevTaskStackNode *node;
+	int index;
+
+	index = hev_task_stack_class (*size);
+	if (index < 0)
+		return hev_task_stack_alloc (*size);
+
+	/* round up to size class */
+	*size = (size_t) 1 << (STACK_CLASS_SHIFT + index * 2);
+	if (!self || !self->cached_stacks[index])
+		return hev_task_stack_alloc (*size);
+
+	/* the node lives at the top of stack, in already committed pages */
+	node = self->cached_stacks[index];
+	self->cached_stacks[index] = node->next;
+	self->cached_size -= *size;
+
+	return (void *) (node + 1) - *size;
+}
+
+void
+hev_task_stack_pool_free (HevTaskStackPool *self, void *stack, size_t size)
+{
+	HevTaskStackNode *node;
+	int index;
+
+	index = hev_task_stack_class (size);
+	if (index < 0) {
+		hev_task_stack_free (stack, size);
+		return;
+	}
+
+	size = (size_t) 1 << (STACK_CLASS_SHIFT + index * 2);
+	if (!self || (self->cached_size + size) > MAX_CACHED_STACK_SIZE) {
+		hev_task_stack_free (stack, size);
+		return;
+	}
+
+	node = (HevTaskStackNode *) (stack + size) - 1;
+	node->next = self->cached_stacks[index];
+	self->cached_stacks[index] = node;
+	self->cached_size += size;
+}
+
+void
+hev_task_stack_pool_trim (HevTaskStackPool *self)
+{
+	int i;
+
+	for (i=0; i<STACK_CLASS_COUNT; i++) {
+		size_t size = (size_t) 1 << (STACK_CLASS_SHIFT + i * 2);
+		HevTaskStackNode *iter = self->cached_stacks[i];
+
+		while (iter) {
+			HevTaskStackNode *next = iter->next;
+			hev_task_stack_free ((void *) (iter + 1) - size, size);
+			iter = next;
+		}
+		self->cached_stacks[i] = NULL;
+	}
+
+	self->cached_size = 0;
+}
+
+static int
+hev_task_stack_class (size_t size)
+{
+	int i;
+
+	for (i=0; i<STACK_CLASS_COUNT; i++) {
+		if (size <= ((size_t) 1 << (STACK_CLASS_SHIFT + i * 2)))
+			return i;
+	}
+
+	return -1;
+}
+
@@ -0,0 +1,28 @@
+/*
+ ============================================================================
+ Name        : hev-task-stack.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Task stack
+ ============================================================================
+ */
+
+#ifndef __HEV_TASK_STACK_H__
+#define __HEV_TASK_STACK_H__
+
+#include <stddef.h>
+
+typedef struct _HevTaskStackPool HevTaskStackPool;
+
+void * hev_task_stack_alloc (size_t size);
+void hev_task_stack_free (void *stack, size_t size);
+
+HevTaskStackPool * hev_task_stack_pool_new (void);
+void hev_task_stack_pool_destroy (HevTaskStackPool *self);
+
+void * hev_task_stack_pool_alloc (HevTaskStackPool *self, size_t *size);
+void hev_task_stack_pool_free (HevTaskStackPool *self, void *stack, size_t size);
+void hev_task_stack_pool_trim (HevTaskStackPool *self);
+
+#endif /* __HEV_TASK_STACK_H__ */
+
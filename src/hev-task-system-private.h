@@ -10,17 +10,56 @@
 #ifndef __HEV_TASK_SYSTEM_PRIVATE_H__
 #define __HEV_TASK_SYSTEM_PRIVATE_H__
 
-#include <setjmp.h>
+#include <stdint.h>
+
+#ifdef ENABLE_PTHREAD
+# include <pthread.h>
+#endif
 
 #include "hev-task.h"
+#include "hev-task-context.h"
 #include "hev-task-private.h"
 #include "hev-task-system.h"
+#include "hev-task-stack.h"
 #include "hev-task-timer-manager.h"
+#include "hev-task-clock.h"
+
+/* headers older than 5.11 lack features required by io_uring backend,
+ * build with epoll only */
+#ifdef ENABLE_IO_URING
+# ifdef __has_include
+#  if !__has_include (<linux/io_uring.h>)
+#   undef ENABLE_IO_URING
+#  endif
+# endif
+#endif
+#ifdef ENABLE_IO_URING
+# include <linux/io_uring.h>
+# ifndef IORING_FEAT_EXT_ARG
+#  undef ENABLE_IO_URING
+# endif
+#endif
+#ifdef ENABLE_IO_URING
+# include "hev-task-io-uring.h"
+#endif
 
 #define HEV_TASK_RUN_SCHEDULER	HEV_TASK_YIELD_COUNT
-#define PRIORITY_COUNT (HEV_TASK_PRIORITY_MAX - HEV_TASK_PRIORITY_MIN + 1)
+#ifdef CONFIG_TASK_PRIORITY_COUNT
+# define PRIORITY_COUNT	CONFIG_TASK_PRIORITY_COUNT
+#else
+# define PRIORITY_COUNT	(32)
+#endif
+/* NOTE: lowest priority of build, HEV_TASK_PRIORITY_LOW is clamped to it */
+#define PRIORITY_MAX	(HEV_TASK_PRIORITY_MIN + PRIORITY_COUNT - 1)
+
+#if PRIORITY_COUNT > 32
+# error "CONFIG_TASK_PRIORITY_COUNT must not exceed the bitmap width (32)"
+#endif
+#define SHARED_STACK_SIZE	CONFIG_TASK_SHARED_STACK_SIZE
 
 typedef struct _HevTaskSystemContext HevTaskSystemContext;
+typedef struct _HevTaskSystemGroup HevTaskSystemGroup;
+typedef struct _HevTaskSchedOps HevTaskSchedOps;
 
 struct _HevTaskSystemContext
 {
@@ -28,21 +67,146 @@ struct _HevTaskSystemContext
 	unsigned int total_task_count;
 	unsigned int running_tasks_bitmap;
 
+	unsigned int io_poll_count;
+	unsigned int io_poll_interval;
+	unsigned int io_poll_budget;
+	uint64_t io_poll_time;
+
+	/* sampled at first read after each pick, 0: not yet */
+	uint64_t now;
+
+	/* cooperative time slice, starts at first check after switched in */
+	uint64_t slice_start;
+	uint64_t time_slice_cycles;
+	unsigned int time_slice;
+
 	HevTaskTimerManager *timer_manager;
+	unsigned int timer_slack; /* default, in microseconds */
+	HevTaskStackPool *stack_pool;
+
+	/* indexed by fd */
+	struct _HevTaskFDWatcher **fd_watchers;
+	unsigned int fd_watcher_size;
+#ifdef ENABLE_IO_URING
+	/* NULL: epoll backend, not supported by kernel */
+	HevTaskIOUring *io_uring;
+#endif
+
+	HevTask *free_tasks;
+	unsigned int free_task_count;
+	unsigned int free_task_max;
+
+	void *shared_stack;
+	HevTask *shared_stack_owner;
 
 	HevTask *current_task;
+	const HevTaskSchedOps *sched_ops;
+	void *sched_data;
+
+	/* earliest deadline first, run before tasks of policy */
+	HevTask *deadline_tasks;
+	HevTask *deadline_tasks_tail;
+
+	/* strict priority policy */
 	HevTask *running_tasks[PRIORITY_COUNT];
 	HevTask *running_tasks_tail[PRIORITY_COUNT];
 
-	jmp_buf kernel_context;
+	HevTaskContext kernel_context;
+
+	/* statistics, read by other threads, word sized to load untorn */
+	unsigned int ready_task_count;
+	unsigned long switch_count;
+	unsigned long idle_time;
+	unsigned long deadline_count;
+	unsigned long deadline_miss_count;
+
+#ifdef ENABLE_PTHREAD
+	/* workers only */
+	HevTaskSystemGroup *group;
+	unsigned int worker_id;
+	int idle;
+
+	/* switched out to be moved, posted in kernel context */
+	HevTask *migrate_task;
+
+	/* posted by other threads, lock-free MPSC stacks */
+	int event_fd;
+	int inbox_notified __attribute__ ((aligned (64)));
+	HevTask *inbox_tasks;
+	HevTask *inbox_wakes;
+#endif
 };
 
+#ifdef ENABLE_PTHREAD
+struct _HevTaskSystemGroup
+{
+	/* written by all workers, keep in separate cache lines */
+	int total_task_count __attribute__ ((aligned (64)));
+	int idle_count __attribute__ ((aligned (64)));
+
+	unsigned int count __attribute__ ((aligned (64)));
+	const HevTaskSchedOps *sched_ops;
+	unsigned int next_index;
+	unsigned int started;
+	unsigned int finished;
+	int error;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	HevTaskSystemContext *workers[];
+};
+#endif
+
 void hev_task_system_schedule (HevTaskYieldType type);
 void hev_task_system_wakeup_task (HevTask *task);
 void hev_task_system_run_new_task (HevTask *task);
+#ifdef ENABLE_PTHREAD
+void hev_task_system_post_new_task (HevTaskSystemContext *ctx, HevTask *task);
+int hev_task_system_migrate_task (HevTask *task, HevTaskSystemContext *target);
+#endif
+int hev_task_system_set_task_deadline (HevTask *task,
+			unsigned int microseconds);
 void hev_task_system_kill_current_task (void);
 
 HevTaskSystemContext * hev_task_system_get_context (void);
 
+static inline uint64_t
+hev_task_system_get_now (HevTaskSystemContext *ctx)
+{
+	/* once per scheduler iteration, if anyone asks */
+	if (!ctx->now)
+		ctx->now = hev_task_clock_time ();
+
+	return ctx->now;
+}
+
+/* timer is of this task system, keep the task here while armed */
+static inline void
+hev_task_system_arm_timer (HevTaskSystemContext *ctx, HevTaskTimer *timer,
+			uint64_t time, unsigned int slack)
+{
+	uint64_t expires = (time + 999) / 1000;
+	uint64_t limit = (time + slack) / 1000;
+
+	if (!hev_task_timer_is_armed (timer))
+		timer->task->pin_count ++;
+
+	/* slack in ticks, up to the last tick within @slack of @time, as
+	 * expiry is rounded up to a tick, it's never later than allowed */
+	timer->time = time;
+	timer->slack = slack;
+	hev_task_timer_manager_add (ctx->timer_manager, timer, expires,
+				(limit > expires) ? limit - expires : 0);
+}
+
+static inline void
+hev_task_system_disarm_timer (HevTaskSystemContext *ctx, HevTaskTimer *timer)
+{
+	if (!hev_task_timer_is_armed (timer))
+		return;
+
+	hev_task_timer_manager_del (ctx->timer_manager, timer);
+	timer->task->pin_count --;
+}
+
 #endif /* __HEV_TASK_SYSTEM_PRIVATE_H__ */
 
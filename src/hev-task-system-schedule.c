@@ -12,73 +12,179 @@
 # undef _FORTIFY_SOURCE
 #endif
 
+#include <time.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/epoll.h>
 
 #include "hev-task-system.h"
 #include "hev-task-system-private.h"
 #include "hev-task-private.h"
 #include "hev-task-executer.h"
+#include "hev-task-sched-priority.h"
+#include "hev-task-fd-watcher.h"
+#include "hev-task-timer-manager.h"
+#include "hev-memory-allocator.h"
+
+#define MAX_SHARE_TASK_COUNT	(32)
 
 static inline void hev_task_system_wakeup_task_with_context (HevTaskSystemContext *ctx,
 			HevTask *task);
-static inline void hev_task_system_append_task (HevTaskSystemContext *ctx,
+static inline void hev_task_system_enqueue_task (HevTaskSystemContext *ctx,
+			HevTask *task, int flags);
+static inline void hev_task_system_dequeue_task (HevTaskSystemContext *ctx,
 			HevTask *task);
+static inline void hev_task_system_finish_deadline (HevTaskSystemContext *ctx,
+			HevTask *task, uint64_t now);
+static inline void hev_task_system_append_task (HevTaskSystemContext *ctx,
+			HevTask *task, int flags);
 static inline void hev_task_system_remove_current_task (HevTaskSystemContext *ctx,
 			HevTaskState state);
 static inline void hev_task_system_reappend_current_task (HevTaskSystemContext *ctx);
-static inline void hev_task_system_pick_current_task (HevTaskSystemContext *ctx);
+static inline int hev_task_system_io_poll_is_due (HevTaskSystemContext *ctx);
+static inline int hev_task_system_io_wait (HevTaskSystemContext *ctx,
+			struct epoll_event *events, int timeout);
+static inline void hev_task_system_expire_timers (HevTaskSystemContext *ctx);
+#ifdef ENABLE_IO_URING
+static int hev_task_system_io_uring_wait (HevTaskSystemContext *ctx,
+			struct epoll_event *events, int timeout);
+#endif
+static inline void hev_task_system_pick_current_task (HevTaskSystemContext *ctx,
+			int timeout);
+static inline void hev_task_system_resume_current_task (HevTaskSystemContext *ctx)
+			__attribute__ ((noreturn));
+static void * hev_task_system_get_stack_pointer (void) __attribute__ ((noinline));
+static inline int hev_task_system_is_finished (HevTaskSystemContext *ctx);
+#ifdef ENABLE_PTHREAD
+static void hev_task_system_task_exited (HevTaskSystemContext *ctx);
+static void hev_task_system_set_idle (HevTaskSystemContext *ctx, int idle);
+static void hev_task_system_share_tasks (HevTaskSystemContext *ctx,
+			HevTask *exclude);
+static void hev_task_system_post_task (HevTaskSystemContext *ctx,
+			HevTask *task);
+static void hev_task_system_post_wakeup (HevTaskSystemContext *ctx,
+			HevTask *task);
+static void hev_task_system_drain_inbox (HevTaskSystemContext *ctx);
+static void hev_task_system_detach_current_task (HevTaskSystemContext *ctx);
+static void hev_task_system_post_migrate_task (HevTaskSystemContext *ctx);
+#endif
 
 void
 hev_task_system_schedule (HevTaskYieldType type)
 {
 	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+	HevTask *task;
 
 	if (ctx->current_task)
 		goto save_task;
 
 	if (type == HEV_TASK_RUN_SCHEDULER) {
-		switch (setjmp (ctx->kernel_context)) {
-		case 1:
-			hev_task_system_reappend_current_task (ctx);
-			break;
+		/* 1: no task ready, 2: current task exited, 3: task migrated */
+		switch (hev_task_context_save (ctx->kernel_context)) {
 		case 2:
 			hev_task_system_remove_current_task (ctx, HEV_TASK_STOPPED);
 			break;
+#ifdef ENABLE_PTHREAD
 		case 3:
-			hev_task_system_remove_current_task (ctx, HEV_TASK_WAITING);
+			hev_task_system_post_migrate_task (ctx);
 			break;
+#endif
 		}
 	}
 
 	/* NOTE: in kernel context */
 	/* All tasks exited, Bye! */
-	if (ctx->total_task_count == 0)
+	if (hev_task_system_is_finished (ctx))
 		return;
 
-	/* pick a task */
-	hev_task_system_pick_current_task (ctx);
+	/* pick a task, block in I/O poll until one is ready */
+	if (!ctx->current_task) {
+		hev_task_system_pick_current_task (ctx, -1);
+		/* all tasks of workers exited */
+		if (!ctx->current_task)
+			return;
+	}
+
+#ifdef ENABLE_PTHREAD
+	if (ctx->group)
+		hev_task_system_share_tasks (ctx, NULL);
+#endif
 
 	/* switch to task */
-	longjmp (ctx->current_task->context, 1);
+	hev_task_system_resume_current_task (ctx);
 
 save_task:
 	/* NOTE: in task context */
+	task = ctx->current_task;
+
+#ifdef ENABLE_PTHREAD
+	if (task->migrate_target && !task->pin_count)
+		hev_task_system_detach_current_task (ctx);
+	else
+#endif
+	if (type == HEV_TASK_WAITIO)
+		hev_task_system_remove_current_task (ctx, HEV_TASK_WAITING);
+	else
+		hev_task_system_reappend_current_task (ctx);
+
+	/* pick next task without blocking */
+	hev_task_system_pick_current_task (ctx, 0);
+
+#ifdef ENABLE_PTHREAD
+	if (ctx->group)
+		hev_task_system_share_tasks (ctx, task);
+#endif
+
+	/* picked itself, keep running */
+	if (ctx->current_task == task) {
+		ctx->slice_start = 0;
+		return;
+	}
+
+	/* mark frames to be copied out of the shared stack */
+	if (!task->stack)
+		task->stack_bottom = hev_task_system_get_stack_pointer ();
+
 	/* save current task context */
-	if (setjmp (ctx->current_task->context))
+	if (hev_task_context_save (task->context))
 		return; /* resume to task context */
 
-	if (type == HEV_TASK_WAITIO)
-		longjmp (ctx->kernel_context, 3);
+#ifdef ENABLE_PTHREAD
+	/* NOTE: post it off the task stack, it may resume at once */
+	if (ctx->migrate_task)
+		hev_task_context_restore (ctx->kernel_context, 3);
+#endif
 
-	/* resume to kernel context */
-	longjmp (ctx->kernel_context, 1);
+	/* switch to next task directly, unless it has to be copied into the
+	 * shared stack that current task is running on */
+	if (ctx->current_task && (task->stack || ctx->current_task->stack))
+		hev_task_system_resume_current_task (ctx);
+
+	/* no task ready, block in I/O poll in kernel context */
+	hev_task_context_restore (ctx->kernel_context, 1);
 }
 
 void
 hev_task_system_wakeup_task (HevTask *task)
 {
+#ifdef ENABLE_PTHREAD
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+	HevTaskSystemContext *owner;
+
+	/* task is owned by another thread, or not run yet */
+	owner = __atomic_load_n (&task->owner, __ATOMIC_ACQUIRE);
+	if (owner != ctx) {
+		if (owner)
+			hev_task_system_post_wakeup (owner, task);
+		return;
+	}
+
+	hev_task_system_wakeup_task_with_context (ctx, task);
+#else
 	hev_task_system_wakeup_task_with_context (NULL, task);
+#endif
 }
 
 void
@@ -86,10 +192,101 @@ hev_task_system_run_new_task (HevTask *task)
 {
 	HevTaskSystemContext *ctx = hev_task_system_get_context ();
 
-	hev_task_execute (task, hev_task_executer);
+	/* shared stack task is set up when switching to it */
+	if (task->stack)
+		hev_task_execute (task, hev_task_executer);
 
-	hev_task_system_append_task (ctx, task);
+	task->owner = ctx;
+	hev_task_system_append_task (ctx, task, HEV_TASK_SCHED_NEW);
 	ctx->total_task_count ++;
+#ifdef ENABLE_PTHREAD
+	if (ctx->group)
+		__atomic_add_fetch (&ctx->group->total_task_count, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+#ifdef ENABLE_PTHREAD
+void
+hev_task_system_post_new_task (HevTaskSystemContext *ctx, HevTask *task)
+{
+	HevTaskSystemContext *self = hev_task_system_get_context ();
+
+	/* fds were added to I/O poll of current thread */
+	if (self)
+		hev_task_detach_fds (task, self);
+
+	hev_task_execute (task, hev_task_executer);
+
+	/* NOTE: stays stopped until picked up, owner counts it as a new task */
+	__atomic_store_n (&task->owner, ctx, __ATOMIC_RELEASE);
+
+	hev_task_system_post_task (ctx, task);
+}
+
+int
+hev_task_system_migrate_task (HevTask *task, HevTaskSystemContext *target)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+	HevTaskSystemContext *owner;
+
+	/* NOTE: tasks are counted by worker group, can't move out of it. A
+	 * system not in a group may have returned from run, or be freed. */
+	if (!target || !ctx->group || target->group != ctx->group)
+		return -1;
+
+	owner = __atomic_load_n (&task->owner, __ATOMIC_RELAXED);
+	if (owner != ctx || task->state == HEV_TASK_STOPPED || !task->stack)
+		return -1;
+
+	if (target == ctx) {
+		task->migrate_target = NULL;
+		return 0;
+	}
+
+	/* NOTE: a pending io_uring op is cancelled by its task to move */
+	task->migrate_target = target;
+	if (task == ctx->current_task)
+		hev_task_system_schedule (HEV_TASK_YIELD);
+	else if (!task->pin_count || task->io_uring_op)
+		hev_task_system_wakeup_task_with_context (ctx, task);
+
+	return 0;
+}
+#endif
+
+int
+hev_task_system_set_task_deadline (HevTask *task, unsigned int microseconds)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+	HevTaskSystemContext *owner;
+	uint64_t now;
+	int queued;
+
+	if (!ctx)
+		return -1;
+
+	/* NOTE: run queues of owner are changed, owned by another worker or
+	 * in its inbox. Tasks not run yet or exited are of the caller. */
+	owner = __atomic_load_n (&task->owner, __ATOMIC_ACQUIRE);
+	if (owner != ctx && (owner || task->state != HEV_TASK_STOPPED))
+		return -1;
+
+	/* ready in this task system, current one included */
+	queued = (task->state == HEV_TASK_RUNNING);
+	/* NOTE: not the cached clock, deadline would be earlier than asked */
+	now = hev_task_clock_time ();
+
+	if (queued)
+		hev_task_system_dequeue_task (ctx, task);
+
+	hev_task_system_finish_deadline (ctx, task, now);
+	if (microseconds)
+		task->sched_entity.deadline = now + microseconds;
+
+	if (queued)
+		hev_task_system_enqueue_task (ctx, task, HEV_TASK_SCHED_WAKEUP);
+
+	return 0;
 }
 
 void
@@ -99,7 +296,7 @@ hev_task_system_kill_current_task (void)
 
 	/* NOTE: remove current task in kernel context, because current
 	 * task stack may be freed. */
-	longjmp (ctx->kernel_context, 2);
+	hev_task_context_restore (ctx->kernel_context, 2);
 }
 
 static inline void
@@ -109,64 +306,116 @@ hev_task_system_wakeup_task_with_context (HevTaskSystemContext *ctx, HevTask *ta
 	if (task->state == HEV_TASK_RUNNING || task->state == HEV_TASK_STOPPED)
 		return;
 
-	task->state = HEV_TASK_RUNNING;
-
 	if (!ctx)
 		ctx = hev_task_system_get_context ();
-	hev_task_system_append_task (ctx, task);
+	hev_task_system_append_task (ctx, task, HEV_TASK_SCHED_WAKEUP);
 }
 
 static inline void
-hev_task_system_append_task (HevTaskSystemContext *ctx, HevTask *task)
+hev_task_system_insert_deadline_task (HevTaskSystemContext *ctx, HevTask *task)
 {
-	HevTask **running_tasks;
-	HevTask **running_tasks_tail;
-
-	task->state = HEV_TASK_RUNNING;
-	task->priority = task->next_priority;
+	HevTask *prev = ctx->deadline_tasks_tail;
 
-	running_tasks = &ctx->running_tasks[task->priority];
-	running_tasks_tail = &ctx->running_tasks_tail[task->priority];
+	/* sorted, later deadlines are more likely, search from tail */
+	while (prev && prev->sched_entity.deadline > task->sched_entity.deadline)
+		prev = prev->prev;
 
-	task->next = NULL;
-	if (*running_tasks_tail) {
-		task->prev = *running_tasks_tail;
-		(*running_tasks_tail)->next = task;
+	task->prev = prev;
+	if (prev) {
+		task->next = prev->next;
+		prev->next = task;
 	} else {
-		task->prev = NULL;
+		task->next = ctx->deadline_tasks;
+		ctx->deadline_tasks = task;
 	}
-	ctx->running_tasks_bitmap |= (1U << task->priority);
 
-	if (!*running_tasks)
-		*running_tasks = task;
+	if (task->next)
+		task->next->prev = task;
+	else
+		ctx->deadline_tasks_tail = task;
+}
 
-	*running_tasks_tail = task;
+static inline void
+hev_task_system_unlink_deadline_task (HevTaskSystemContext *ctx, HevTask *task)
+{
+	if (task->prev)
+		task->prev->next = task->next;
+	else
+		ctx->deadline_tasks = task->next;
+
+	if (task->next)
+		task->next->prev = task->prev;
+	else
+		ctx->deadline_tasks_tail = task->prev;
 }
 
 static inline void
-hev_task_system_remove_current_task (HevTaskSystemContext *ctx, HevTaskState state)
+hev_task_system_enqueue_task (HevTaskSystemContext *ctx, HevTask *task,
+			int flags)
 {
-	HevTask *task = ctx->current_task;
-	HevTask **running_tasks;
-	HevTask **running_tasks_tail;
+	if (task->sched_entity.deadline)
+		hev_task_system_insert_deadline_task (ctx, task);
+	else
+		HEV_TASK_SCHED_CALL (ctx, enqueue, task, flags);
+}
 
-	task->state = state;
+static inline void
+hev_task_system_dequeue_task (HevTaskSystemContext *ctx, HevTask *task)
+{
+	if (task->sched_entity.deadline)
+		hev_task_system_unlink_deadline_task (ctx, task);
+	else
+		HEV_TASK_SCHED_CALL (ctx, dequeue, task);
+}
+
+static inline void
+hev_task_system_finish_deadline (HevTaskSystemContext *ctx, HevTask *task,
+			uint64_t now)
+{
+	if (!task->sched_entity.deadline)
+		return;
 
-	running_tasks = &ctx->running_tasks[task->priority];
-	running_tasks_tail = &ctx->running_tasks_tail[task->priority];
+	ctx->deadline_count ++;
+	if (now > task->sched_entity.deadline)
+		ctx->deadline_miss_count ++;
+	task->sched_entity.deadline = 0;
+}
 
-	*running_tasks = task->next;
-	if (*running_tasks) {
-		(*running_tasks)->prev = NULL;
-	} else {
-		*running_tasks_tail = NULL;
-		ctx->running_tasks_bitmap ^= (1U << task->priority);
-	}
+static inline void
+hev_task_system_append_task (HevTaskSystemContext *ctx, HevTask *task,
+			int flags)
+{
+	task->state = HEV_TASK_RUNNING;
+	hev_task_system_enqueue_task (ctx, task, flags);
+	ctx->ready_task_count ++;
+}
+
+static inline void
+hev_task_system_remove_current_task (HevTaskSystemContext *ctx, HevTaskState state)
+{
+	HevTask *task = ctx->current_task;
 
+	task->state = state;
+	hev_task_system_dequeue_task (ctx, task);
 	ctx->current_task = NULL;
+	ctx->ready_task_count --;
 
 	if (HEV_TASK_STOPPED == state) {
+		if (task->sched_entity.deadline)
+			hev_task_system_finish_deadline (ctx, task,
+						hev_task_system_get_now (ctx));
+		if (ctx->shared_stack_owner == task)
+			ctx->shared_stack_owner = NULL;
+		/* waiters of fd watchers of this worker, may be freed by others */
+		hev_task_free_fds (task);
 		ctx->total_task_count --;
+#ifdef ENABLE_PTHREAD
+		if (ctx->group)
+			hev_task_system_task_exited (ctx);
+#endif
+		/* NOTE: task system may be freed before the task, later wakeups
+		 * from other threads are dropped */
+		__atomic_store_n (&task->owner, NULL, __ATOMIC_RELEASE);
 		hev_task_unref (task);
 	}
 }
@@ -175,88 +424,527 @@ static inline void
 hev_task_system_reappend_current_task (HevTaskSystemContext *ctx)
 {
 	HevTask *task = ctx->current_task;
-	HevTask **running_tasks;
-	HevTask **running_tasks_tail;
 
+	/* after the ones with the same deadline */
+	if (task->sched_entity.deadline) {
+		hev_task_system_unlink_deadline_task (ctx, task);
+		hev_task_system_insert_deadline_task (ctx, task);
+	} else {
+		HEV_TASK_SCHED_CALL (ctx, requeue, task);
+	}
 	ctx->current_task = NULL;
+}
 
-	if (task->priority == task->next_priority) {
-		if (!task->next)
-			return;
-
-		running_tasks = &ctx->running_tasks[task->priority];
-		running_tasks_tail = &ctx->running_tasks_tail[task->priority];
+static inline uint64_t
+hev_task_system_get_coarse_clock (void)
+{
+	struct timespec ts;
 
-		*running_tasks = task->next;
+	/* vDSO, kernel tick granularity */
+	clock_gettime (CLOCK_MONOTONIC_COARSE, &ts);
 
-		task->next = NULL;
-		task->prev = *running_tasks_tail;
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
-		(*running_tasks)->prev = NULL;
-		(*running_tasks_tail)->next = task;
-		*running_tasks_tail = task;
-		return;
+static inline int
+hev_task_system_io_poll_is_due (HevTaskSystemContext *ctx)
+{
+	if (ctx->io_poll_interval) {
+		ctx->io_poll_count ++;
+		if (ctx->io_poll_count >= ctx->io_poll_interval)
+			return 1;
 	}
 
-	/* remove */
-	running_tasks = &ctx->running_tasks[task->priority];
-	running_tasks_tail = &ctx->running_tasks_tail[task->priority];
+	if (ctx->io_poll_budget) {
+		uint64_t elapsed;
 
-	*running_tasks = task->next;
-	if (*running_tasks) {
-		(*running_tasks)->prev = NULL;
-	} else {
-		*running_tasks_tail = NULL;
-		ctx->running_tasks_bitmap ^= (1U << task->priority);
+		elapsed = hev_task_system_get_coarse_clock () - ctx->io_poll_time;
+		if (elapsed >= ctx->io_poll_budget)
+			return 1;
 	}
 
-	/* append */
-	task->priority = task->next_priority;
-	running_tasks = &ctx->running_tasks[task->priority];
-	running_tasks_tail = &ctx->running_tasks_tail[task->priority];
+	return 0;
+}
 
-	task->next = NULL;
-	if (*running_tasks_tail) {
-		task->prev = *running_tasks_tail;
-		(*running_tasks_tail)->next = task;
-	} else {
-		task->prev = NULL;
-	}
-	ctx->running_tasks_bitmap |= (1U << task->priority);
+static inline int
+hev_task_system_io_wait (HevTaskSystemContext *ctx, struct epoll_event *events,
+			int timeout)
+{
+#ifdef ENABLE_IO_URING
+	if (ctx->io_uring)
+		return hev_task_system_io_uring_wait (ctx, events, timeout);
+#endif
+
+	return epoll_wait (ctx->epoll_fd, events, 128, timeout);
+}
 
-	if (!*running_tasks)
-		*running_tasks = task;
+static inline void
+hev_task_system_expire_timers (HevTaskSystemContext *ctx)
+{
+	uint64_t now = hev_task_system_get_now (ctx);
+	HevTaskTimer *timer;
+
+	timer = hev_task_timer_manager_expire (ctx->timer_manager, now / 1000);
+	while (timer) {
+		HevTaskTimer *next = timer->next;
+
+		/* disarmed, periodic ones are rearmed */
+		timer->expirations ++;
+		timer->task->pin_count --;
+		if (timer->interval) {
+			uint64_t time = timer->time + timer->interval;
+
+			/* from the previous one, count the missed ones at once */
+			if (time <= now) {
+				uint64_t missed = (now - time) / timer->interval + 1;
+
+				timer->expirations += missed;
+				time += missed * timer->interval;
+			}
+			hev_task_system_arm_timer (ctx, timer, time, timer->slack);
+		}
 
-	*running_tasks_tail = task;
+		hev_task_system_wakeup_task_with_context (ctx, timer->task);
+		timer = next;
+	}
 }
 
 static inline void
-hev_task_system_pick_current_task (HevTaskSystemContext *ctx)
+hev_task_system_pick_current_task (HevTaskSystemContext *ctx, int timeout)
 {
-	int i, count, timeout = 0;
+	int i, count, wait_timeout = 0;
 	struct epoll_event events[128];
+	uint64_t idle_start = 0;
+
+	/* new iteration, clock is sampled on demand */
+	ctx->now = 0;
+
+	/* skip io poll while tasks are ready and no poll is due */
+	if (!timeout && ctx->ready_task_count &&
+				!hev_task_system_io_poll_is_due (ctx))
+		goto pick;
 
 retry:
-	/* io poll */
-	count = epoll_wait (ctx->epoll_fd, events, 128, timeout);
+#ifdef ENABLE_PTHREAD
+	/* ask busy workers for tasks while blocking */
+	if (wait_timeout && ctx->group)
+		hev_task_system_set_idle (ctx, 1);
+#endif
+
+	/* io poll, sample clock again after blocking */
+	if (wait_timeout)
+		idle_start = hev_task_system_get_now (ctx);
+	count = hev_task_system_io_wait (ctx, events, wait_timeout);
+	if (wait_timeout) {
+		ctx->now = 0;
+		ctx->idle_time += hev_task_system_get_now (ctx) - idle_start;
+	}
+
+#ifdef ENABLE_PTHREAD
+	if (wait_timeout && ctx->group)
+		hev_task_system_set_idle (ctx, 0);
+#endif
+
 	for (i=0; i<count; i++) {
-		HevTaskSchedEntity *sched_entity;
+		HevTaskFDWatcher *watcher;
+		HevTaskFD *task_fd;
+
+		watcher = events[i].data.ptr;
+#ifdef ENABLE_PTHREAD
+		/* inbox of worker */
+		if (!watcher) {
+			hev_task_system_drain_inbox (ctx);
+			continue;
+		}
+#endif
+		/* to the waiters for them, errors and hang up are for all */
+		task_fd = watcher->waiters;
+		for (; task_fd; task_fd=task_fd->watcher_next) {
+			unsigned int ready;
 
-		sched_entity = events[i].data.ptr;
-		hev_task_system_wakeup_task_with_context (ctx, sched_entity->task);
+			ready = events[i].events & (task_fd->events | EPOLLERR | EPOLLHUP);
+			if (!ready)
+				continue;
+
+			task_fd->ready |= ready;
+			hev_task_system_wakeup_task_with_context (ctx, task_fd->task);
+		}
 	}
 
-	/* no task ready, retry */
-	if (!ctx->running_tasks_bitmap) {
-		timeout = -1;
+	hev_task_system_expire_timers (ctx);
+
+	ctx->io_poll_count = 0;
+	if (ctx->io_poll_budget)
+		ctx->io_poll_time = hev_task_system_get_coarse_clock ();
+
+	/* no task ready, retry or give up */
+	if (!ctx->ready_task_count) {
+		if (timeout == 0 || hev_task_system_is_finished (ctx))
+			return;
+		/* until next timer expires */
+		wait_timeout = hev_task_timer_manager_get_timeout (ctx->timer_manager,
+					hev_task_system_get_now (ctx) / 1000);
 		goto retry;
 	}
 
-	for (i=HEV_TASK_PRIORITY_MIN; i<=HEV_TASK_PRIORITY_MAX; i++) {
-		if (ctx->running_tasks[i]) {
-			ctx->current_task = ctx->running_tasks[i];
-			return;
+pick:
+	/* earliest deadline first, before any policy */
+	if (ctx->deadline_tasks)
+		ctx->current_task = ctx->deadline_tasks;
+	else
+		ctx->current_task = HEV_TASK_SCHED_CALL (ctx, pick);
+}
+
+static inline void
+hev_task_system_save_shared_stack (HevTask *task)
+{
+	size_t size = task->stack_top - task->stack_bottom;
+
+	/* keep the buffer right-sized */
+	if (size > task->saved_stack_size || size < task->saved_stack_size / 2) {
+		if (task->saved_stack)
+			hev_free (task->saved_stack);
+		task->saved_stack = hev_malloc (size);
+		if (!task->saved_stack)
+			abort ();
+		task->saved_stack_size = size;
+	}
+
+	memcpy (task->saved_stack, task->stack_bottom, size);
+}
+
+static inline void
+hev_task_system_resume_current_task (HevTaskSystemContext *ctx)
+{
+	HevTask *task = ctx->current_task;
+
+	/* NOTE: never runs on the shared stack when switching to a task that
+	 * is not the owner of shared stack */
+	if (!task->stack && ctx->shared_stack_owner != task) {
+		HevTask *owner = ctx->shared_stack_owner;
+
+		if (owner)
+			hev_task_system_save_shared_stack (owner);
+		ctx->shared_stack_owner = task;
+
+		if (task->saved_stack) {
+			memcpy (task->stack_bottom, task->saved_stack,
+						task->stack_top - task->stack_bottom);
+		} else {
+			/* first run of task */
+			hev_task_execute (task, hev_task_executer);
+		}
+	}
+
+	ctx->switch_count ++;
+	ctx->slice_start = 0;
+	hev_task_context_restore (task->context, 1);
+}
+
+static void *
+hev_task_system_get_stack_pointer (void)
+{
+	/* lower than stack pointer of caller */
+	return __builtin_frame_address (0);
+}
+
+static inline int
+hev_task_system_is_finished (HevTaskSystemContext *ctx)
+{
+#ifdef ENABLE_PTHREAD
+	if (ctx->group)
+		return !__atomic_load_n (&ctx->group->total_task_count,
+					__ATOMIC_ACQUIRE);
+#endif
+
+	return ctx->total_task_count == 0;
+}
+
+#ifdef ENABLE_PTHREAD
+static inline void
+hev_task_system_notify (HevTaskSystemContext *ctx)
+{
+	uint64_t value = 1;
+
+	/* one eventfd write per batch, until the inbox is drained */
+	if (__atomic_exchange_n (&ctx->inbox_notified, 1, __ATOMIC_SEQ_CST))
+		return;
+
+	if (write (ctx->event_fd, &value, sizeof (value)) == -1) {
+		/* counter saturated, a wakeup is pending anyway */
+	}
+}
+
+static void
+hev_task_system_task_exited (HevTaskSystemContext *ctx)
+{
+	HevTaskSystemGroup *group = ctx->group;
+	unsigned int i;
+
+	if (__atomic_sub_fetch (&group->total_task_count, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	/* last task of workers, wake up all to exit */
+	for (i=0; i<group->count; i++)
+		hev_task_system_notify (group->workers[i]);
+}
+
+static void
+hev_task_system_set_idle (HevTaskSystemContext *ctx, int idle)
+{
+	HevTaskSystemGroup *group = ctx->group;
+
+	if (idle) {
+		__atomic_store_n (&ctx->idle, 1, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch (&group->idle_count, 1, __ATOMIC_SEQ_CST);
+		return;
+	}
+
+	/* otherwise claimed by a busy worker, which sends tasks to inbox */
+	if (__atomic_exchange_n (&ctx->idle, 0, __ATOMIC_SEQ_CST))
+		__atomic_sub_fetch (&group->idle_count, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline HevTaskSystemContext *
+hev_task_system_claim_idle_worker (HevTaskSystemContext *ctx)
+{
+	HevTaskSystemGroup *group = ctx->group;
+	unsigned int i;
+
+	for (i=1; i<group->count; i++) {
+		HevTaskSystemContext *peer;
+		int idle = 1;
+
+		peer = group->workers[(ctx->worker_id + i) % group->count];
+		if (!__atomic_load_n (&peer->idle, __ATOMIC_RELAXED))
+			continue;
+		if (__atomic_compare_exchange_n (&peer->idle, &idle, 0, 0,
+						__ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+			__atomic_sub_fetch (&group->idle_count, 1, __ATOMIC_SEQ_CST);
+			return peer;
+		}
+	}
+
+	return NULL;
+}
+
+static inline int
+hev_task_system_task_is_movable (HevTaskSystemContext *ctx, HevTask *task,
+			HevTask *exclude)
+{
+	/* running or being switched out */
+	if (task == exclude || task == ctx->current_task)
+		return 0;
+
+	/* frames on the shared stack of this worker */
+	if (!task->stack)
+		return 0;
+
+	/* waiting for an operation of this worker */
+	if (task->pin_count)
+		return 0;
+
+	/* referenced by others, e.g. a posted wakeup */
+	return __atomic_load_n (&task->ref_count, __ATOMIC_RELAXED) == 1;
+}
+
+static void
+hev_task_system_share_tasks (HevTaskSystemContext *ctx, HevTask *exclude)
+{
+	const HevTaskSchedOps *ops = ctx->sched_ops;
+	HevTask *tasks[MAX_SHARE_TASK_COUNT * 2];
+	HevTaskSystemContext *peer;
+	HevTask *task = NULL;
+	unsigned int i, count = 0;
+
+	if (!__atomic_load_n (&ctx->group->idle_count, __ATOMIC_RELAXED))
+		return;
+
+	/* least urgent first */
+	while (count < (MAX_SHARE_TASK_COUNT * 2)) {
+		task = ops->iterate (ctx, task);
+		if (!task)
+			break;
+		if (hev_task_system_task_is_movable (ctx, task, exclude))
+			tasks[count++] = task;
+	}
+
+	if (!count)
+		return;
+
+	peer = hev_task_system_claim_idle_worker (ctx);
+	if (!peer)
+		return;
+
+	/* half of ready tasks, current one stays here */
+	count = (count + 1) / 2;
+	for (i=0; i<count; i++) {
+		task = tasks[i];
+
+		ops->dequeue (ctx, task);
+		ctx->ready_task_count --;
+		hev_task_detach_fds (task, ctx);
+		ctx->total_task_count --;
+		__atomic_store_n (&task->owner, peer, __ATOMIC_RELEASE);
+	}
+
+	for (i=0; i<count; i++)
+		hev_task_system_post_task (peer, tasks[i]);
+	hev_task_system_notify (peer);
+}
+
+static inline HevTask *
+hev_task_system_reverse_list (HevTask *list, int wake)
+{
+	HevTask *prev = NULL;
+
+	while (list) {
+		HevTask *next = wake ? list->wake_next : list->next;
+
+		if (wake)
+			list->wake_next = prev;
+		else
+			list->next = prev;
+		prev = list;
+		list = next;
+	}
+
+	return prev;
+}
+
+static void
+hev_task_system_post_task (HevTaskSystemContext *ctx, HevTask *task)
+{
+	HevTask *head = __atomic_load_n (&ctx->inbox_tasks, __ATOMIC_RELAXED);
+
+	do {
+		task->next = head;
+	} while (!__atomic_compare_exchange_n (&ctx->inbox_tasks, &head, task,
+					1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+	hev_task_system_notify (ctx);
+}
+
+static void
+hev_task_system_post_wakeup (HevTaskSystemContext *ctx, HevTask *task)
+{
+	HevTask *head;
+
+	/* already pending, one wakeup is enough */
+	if (__atomic_exchange_n (&task->wake_pending, 1, __ATOMIC_ACQUIRE))
+		return;
+
+	/* stale owner is fine, it forwards the wakeup */
+	hev_task_ref (task);
+
+	head = __atomic_load_n (&ctx->inbox_wakes, __ATOMIC_RELAXED);
+	do {
+		task->wake_next = head;
+	} while (!__atomic_compare_exchange_n (&ctx->inbox_wakes, &head, task,
+					1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+	hev_task_system_notify (ctx);
+}
+
+static void
+hev_task_system_drain_inbox (HevTaskSystemContext *ctx)
+{
+	HevTask *tasks, *wakes;
+	uint64_t value;
+
+	/* NOTE: reset counter and flag before taking the lists, any later
+	 * post makes a new event */
+	if (read (ctx->event_fd, &value, sizeof (value)) == -1) {
+		/* nothing posted since last drain */
+	}
+	__atomic_store_n (&ctx->inbox_notified, 0, __ATOMIC_SEQ_CST);
+
+	/* MPSC stacks, take all at once and restore posting order */
+	tasks = __atomic_exchange_n (&ctx->inbox_tasks, NULL, __ATOMIC_SEQ_CST);
+	wakes = __atomic_exchange_n (&ctx->inbox_wakes, NULL, __ATOMIC_SEQ_CST);
+	tasks = hev_task_system_reverse_list (tasks, 0);
+	wakes = hev_task_system_reverse_list (wakes, 1);
+
+	while (tasks) {
+		HevTask *task = tasks;
+
+		tasks = task->next;
+		hev_task_attach_fds (task, ctx);
+		ctx->total_task_count ++;
+		/* new task from hev_task_system_run_task, others are moved */
+		if (task->state == HEV_TASK_STOPPED && ctx->group)
+			__atomic_add_fetch (&ctx->group->total_task_count, 1,
+						__ATOMIC_RELAXED);
+		hev_task_system_append_task (ctx, task, HEV_TASK_SCHED_NEW);
+	}
+
+	while (wakes) {
+		HevTask *task = wakes;
+
+		wakes = task->wake_next;
+		__atomic_store_n (&task->wake_pending, 0, __ATOMIC_RELEASE);
+		hev_task_system_wakeup_task (task);
+		hev_task_unref (task);
+	}
+}
+
+static void
+hev_task_system_detach_current_task (HevTaskSystemContext *ctx)
+{
+	HevTask *task = ctx->current_task;
+
+	hev_task_system_remove_current_task (ctx, HEV_TASK_WAITING);
+	hev_task_detach_fds (task, ctx);
+	ctx->total_task_count --;
+	ctx->migrate_task = task;
+}
+
+static void
+hev_task_system_post_migrate_task (HevTaskSystemContext *ctx)
+{
+	HevTask *task = ctx->migrate_task;
+	HevTaskSystemContext *target = task->migrate_target;
+
+	ctx->migrate_task = NULL;
+	task->migrate_target = NULL;
+	__atomic_store_n (&task->owner, target, __ATOMIC_RELEASE);
+	hev_task_system_post_task (target, task);
+}
+#endif /* ENABLE_PTHREAD */
+
+#ifdef ENABLE_IO_URING
+static int
+hev_task_system_io_uring_wait (HevTaskSystemContext *ctx,
+			struct epoll_event *events, int timeout)
+{
+	struct io_uring_cqe cqes[128];
+	unsigned int i, n;
+	int count = 0;
+
+	/* submit queued operations, all at once */
+	hev_task_io_uring_enter (ctx->io_uring, timeout);
+
+	n = hev_task_io_uring_reap (ctx->io_uring, cqes, 128);
+	for (i=0; i<n; i++) {
+		HevTaskIOUringOp *op = (void *) (uintptr_t) cqes[i].user_data;
+
+		/* epoll_fd is ready, get its events and rearm */
+		if (!op) {
+			count = epoll_wait (ctx->epoll_fd, events, 128, 0);
+			hev_task_io_uring_watch (ctx->io_uring, ctx->epoll_fd);
+			continue;
 		}
+
+		/* cancelled op completes on its own */
+		if (op == HEV_TASK_IO_URING_CANCEL)
+			continue;
+
+		op->res = cqes[i].res;
+		op->done = 1;
+		hev_task_system_wakeup_task_with_context (ctx, op->task);
 	}
+
+	return count;
 }
+#endif
 
@@ -14,17 +14,43 @@
 
 #ifdef ENABLE_PTHREAD
 # include <pthread.h>
+# include <sys/eventfd.h>
 #endif
 
 #include "hev-task-system.h"
 #include "hev-task-system-private.h"
+#include "hev-task-sched.h"
+#include "hev-task-fd-watcher.h"
 #include "hev-memory-allocator-slice.h"
 
+#define DEFAULT_IO_POLL_INTERVAL	CONFIG_TASK_IO_POLL_INTERVAL
+#define DEFAULT_IO_POLL_BUDGET	CONFIG_TASK_IO_POLL_BUDGET
+#define DEFAULT_TASK_CACHE_MAX_COUNT	CONFIG_TASK_CACHE_MAX_COUNT
+#define DEFAULT_TIME_SLICE	CONFIG_TASK_TIME_SLICE
+#define DEFAULT_TIMER_SLACK	CONFIG_TASK_TIMER_SLACK
+#define IO_URING_ENTRIES	CONFIG_TASK_IO_URING_ENTRIES
+
+#if (DEFAULT_IO_POLL_INTERVAL == 0) && (DEFAULT_IO_POLL_BUDGET == 0)
+# error "CONFIG_TASK_IO_POLL_INTERVAL and CONFIG_TASK_IO_POLL_BUDGET can't be both 0"
+#endif
+
+static void hev_task_system_trim_free_tasks (HevTaskSystemContext *ctx,
+			unsigned int max_count);
+static int hev_task_system_set_sched_ops (HevTaskSystemContext *ctx,
+			const HevTaskSchedOps *ops);
+
 #ifdef ENABLE_PTHREAD
 static pthread_key_t key;
 static pthread_once_t key_once = PTHREAD_ONCE_INIT;
 
 static void pthread_key_creator (void);
+static void hev_task_system_join_group (HevTaskSystemGroup *group,
+			unsigned int index);
+static void hev_task_system_leave_group (void);
+static int hev_task_system_sync_group (HevTaskSystemGroup *group,
+			unsigned int *count, int error);
+static void * hev_task_system_worker_entry (void *data);
+static void hev_task_system_drop_inbox (HevTaskSystemContext *ctx);
 #else
 static HevTaskSystemContext *default_context;
 #endif
@@ -33,6 +59,9 @@ int
 hev_task_system_init (void)
 {
 	int flags;
+#ifdef ENABLE_PTHREAD
+	struct epoll_event event;
+#endif
 
 #ifdef ENABLE_MEMALLOC_SLICE
 	HevMemoryAllocator *allocator;
@@ -82,6 +111,43 @@ hev_task_system_init (void)
 	if (-1 == fcntl (default_context->epoll_fd, F_SETFD, flags))
 		return -6;
 
+	default_context->stack_pool = hev_task_stack_pool_new ();
+	if (!default_context->stack_pool)
+		return -7;
+
+#ifdef ENABLE_IO_URING
+	/* io_uring if supported by kernel, I/O poll reaps epoll_fd from it */
+	default_context->io_uring = hev_task_io_uring_new (IO_URING_ENTRIES);
+	if (default_context->io_uring &&
+				hev_task_io_uring_watch (default_context->io_uring,
+					default_context->epoll_fd) == -1) {
+		hev_task_io_uring_destroy (default_context->io_uring);
+		default_context->io_uring = NULL;
+	}
+#endif
+
+	default_context->sched_ops = &hev_task_sched_priority;
+	hev_task_sched_priority.init (default_context);
+
+#ifdef ENABLE_PTHREAD
+	default_context->event_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (-1 == default_context->event_fd)
+		return -8;
+
+	/* NULL: inbox, posted by other threads */
+	event.events = EPOLLIN | EPOLLET;
+	event.data.ptr = NULL;
+	if (-1 == epoll_ctl (default_context->epoll_fd, EPOLL_CTL_ADD,
+					default_context->event_fd, &event))
+		return -9;
+#endif
+
+	default_context->io_poll_interval = DEFAULT_IO_POLL_INTERVAL;
+	default_context->io_poll_budget = DEFAULT_IO_POLL_BUDGET;
+	default_context->free_task_max = DEFAULT_TASK_CACHE_MAX_COUNT;
+	default_context->time_slice = DEFAULT_TIME_SLICE;
+	default_context->timer_slack = DEFAULT_TIMER_SLACK;
+
 	return 0;
 }
 
@@ -95,8 +161,24 @@ hev_task_system_fini (void)
 	HevTaskSystemContext *default_context = pthread_getspecific (key);
 #endif
 
+#ifdef ENABLE_PTHREAD
+	hev_task_system_drop_inbox (default_context);
+#endif
+	hev_task_system_trim_free_tasks (default_context, 0);
+	default_context->sched_ops->fini (default_context);
+#ifdef ENABLE_PTHREAD
+	close (default_context->event_fd);
+#endif
+#ifdef ENABLE_IO_URING
+	if (default_context->io_uring)
+		hev_task_io_uring_destroy (default_context->io_uring);
+#endif
 	close (default_context->epoll_fd);
+	hev_task_fd_watcher_free_all (default_context);
 	hev_task_timer_manager_destroy (default_context->timer_manager);
+	hev_task_stack_pool_destroy (default_context->stack_pool);
+	if (default_context->shared_stack)
+		hev_task_stack_free (default_context->shared_stack, SHARED_STACK_SIZE);
 	hev_free (default_context);
 
 #ifdef ENABLE_PTHREAD
@@ -118,6 +200,210 @@ hev_task_system_run (void)
 	hev_task_system_schedule (HEV_TASK_RUN_SCHEDULER);
 }
 
+int
+hev_task_system_run_workers (unsigned int count)
+{
+#ifdef ENABLE_PTHREAD
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+	HevTaskSystemGroup *group;
+	pthread_t *threads;
+	unsigned int i;
+	int error;
+
+	if (count <= 1) {
+		hev_task_system_run ();
+		return 0;
+	}
+
+	group = hev_malloc0 (sizeof (HevTaskSystemGroup) +
+				sizeof (HevTaskSystemContext *) * count);
+	if (!group)
+		return -1;
+
+	threads = hev_malloc (sizeof (pthread_t) * count);
+	if (!threads) {
+		hev_free (group);
+		return -1;
+	}
+
+	group->count = count;
+	group->next_index = 1;
+	group->total_task_count = ctx->total_task_count;
+	group->sched_ops = ctx->sched_ops;
+	pthread_mutex_init (&group->mutex, NULL);
+	pthread_cond_init (&group->cond, NULL);
+
+	for (i=1; i<count; i++) {
+		if (pthread_create (&threads[i], NULL,
+					hev_task_system_worker_entry, group) != 0)
+			break;
+	}
+
+	/* not all threads created, run none of them */
+	if (i < count) {
+		pthread_mutex_lock (&group->mutex);
+		group->count = i;
+		group->error = 1;
+		pthread_mutex_unlock (&group->mutex);
+	}
+
+	hev_task_system_join_group (group, 0);
+	error = hev_task_system_sync_group (group, &group->started, 0);
+	if (!error)
+		hev_task_system_schedule (HEV_TASK_RUN_SCHEDULER);
+	hev_task_system_sync_group (group, &group->finished, error);
+	hev_task_system_leave_group ();
+
+	for (count=i, i=1; i<count; i++)
+		pthread_join (threads[i], NULL);
+
+	pthread_cond_destroy (&group->cond);
+	pthread_mutex_destroy (&group->mutex);
+	hev_free (threads);
+	hev_free (group);
+
+	return error;
+#else
+	if (count > 1)
+		return -1;
+
+	hev_task_system_run ();
+	return 0;
+#endif
+}
+
+HevTaskSystem *
+hev_task_system_self (void)
+{
+	return hev_task_system_get_context ();
+}
+
+int
+hev_task_system_run_task (HevTaskSystem *self, HevTask *task,
+			HevTaskEntry entry, void *data)
+{
+	if (self == hev_task_system_get_context ()) {
+		hev_task_run (task, entry, data);
+		return 0;
+	}
+
+#ifdef ENABLE_PTHREAD
+	/* already running, or frames on the shared stack of this thread */
+	if (task->state != HEV_TASK_STOPPED || !task->stack)
+		return -1;
+
+	task->entry = entry;
+	task->data = data;
+	task->priority = task->next_priority;
+
+	hev_task_system_post_new_task (self, task);
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+void
+hev_task_system_get_stats (HevTaskSystem *self, HevTaskSystemStats *stats)
+{
+	/* NOTE: written by owner thread without locking */
+	stats->task_count = __atomic_load_n (&self->total_task_count,
+				__ATOMIC_RELAXED);
+	stats->ready_task_count = __atomic_load_n (&self->ready_task_count,
+				__ATOMIC_RELAXED);
+	stats->switch_count = __atomic_load_n (&self->switch_count,
+				__ATOMIC_RELAXED);
+	stats->idle_time = __atomic_load_n (&self->idle_time, __ATOMIC_RELAXED);
+	stats->deadline_count = __atomic_load_n (&self->deadline_count,
+				__ATOMIC_RELAXED);
+	stats->deadline_miss_count = __atomic_load_n (&self->deadline_miss_count,
+				__ATOMIC_RELAXED);
+}
+
+int
+hev_task_system_set_sched_policy (HevTaskSystemSchedPolicy policy)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+	const HevTaskSchedOps *ops;
+
+	switch (policy) {
+	case HEV_TASK_SYSTEM_SCHED_PRIORITY:
+		ops = &hev_task_sched_priority;
+		break;
+	case HEV_TASK_SYSTEM_SCHED_FAIR:
+		ops = &hev_task_sched_fair;
+		break;
+	default:
+		return -1;
+	}
+
+	/* tasks are kept by current policy */
+	if (ctx->total_task_count)
+		return -1;
+
+	return hev_task_system_set_sched_ops (ctx, ops);
+}
+
+int
+hev_task_system_set_io_poll_policy (unsigned int interval, unsigned int budget)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+
+	/* starves I/O and timers, polled only when no task is ready */
+	if (!interval && !budget)
+		return -1;
+
+	ctx->io_poll_count = 0;
+	ctx->io_poll_interval = interval;
+	ctx->io_poll_budget = budget;
+
+	return 0;
+}
+
+void
+hev_task_system_set_time_slice (unsigned int microseconds)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+
+	/* converted on demand */
+	ctx->time_slice = microseconds;
+	ctx->time_slice_cycles = 0;
+}
+
+void
+hev_task_system_set_timer_slack (unsigned int microseconds)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+
+	ctx->timer_slack = microseconds;
+}
+
+void
+hev_task_system_set_task_cache_size (unsigned int count)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+
+	ctx->free_task_max = count;
+	hev_task_system_trim_free_tasks (ctx, count);
+}
+
+void
+hev_task_system_trim (void)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+
+	hev_task_system_trim_free_tasks (ctx, 0);
+	hev_task_stack_pool_trim (ctx->stack_pool);
+}
+
+unsigned long long
+hev_task_system_now (void)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+
+	return hev_task_system_get_now (ctx);
+}
+
 HevTaskSystemContext *
 hev_task_system_get_context (void)
 {
@@ -136,3 +422,120 @@ pthread_key_creator (void)
 }
 #endif
 
+static void
+hev_task_system_trim_free_tasks (HevTaskSystemContext *ctx,
+			unsigned int max_count)
+{
+	while (ctx->free_task_count > max_count) {
+		HevTask *task = ctx->free_tasks;
+
+		ctx->free_tasks = task->next;
+		ctx->free_task_count --;
+		hev_task_destroy (task);
+	}
+}
+
+static int
+hev_task_system_set_sched_ops (HevTaskSystemContext *ctx,
+			const HevTaskSchedOps *ops)
+{
+	if (ctx->sched_ops == ops)
+		return 0;
+
+	ctx->sched_ops->fini (ctx);
+	ctx->sched_ops = ops;
+	if (ops->init (ctx) == 0)
+		return 0;
+
+	/* never fails */
+	ctx->sched_ops = &hev_task_sched_priority;
+	hev_task_sched_priority.init (ctx);
+	return -1;
+}
+
+#ifdef ENABLE_PTHREAD
+static void
+hev_task_system_join_group (HevTaskSystemGroup *group, unsigned int index)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+
+	ctx->worker_id = index;
+	ctx->group = group;
+	group->workers[index] = ctx;
+}
+
+static void
+hev_task_system_leave_group (void)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+
+	if (ctx)
+		ctx->group = NULL;
+}
+
+static int
+hev_task_system_sync_group (HevTaskSystemGroup *group, unsigned int *count,
+			int error)
+{
+	pthread_mutex_lock (&group->mutex);
+	if (error)
+		group->error = 1;
+	(*count) ++;
+	pthread_cond_broadcast (&group->cond);
+	while (*count < group->count)
+		pthread_cond_wait (&group->cond, &group->mutex);
+	error = group->error ? -1 : 0;
+	pthread_mutex_unlock (&group->mutex);
+
+	return error;
+}
+
+static void *
+hev_task_system_worker_entry (void *data)
+{
+	HevTaskSystemGroup *group = data;
+	unsigned int index;
+	int error = -1;
+
+	index = __atomic_fetch_add (&group->next_index, 1, __ATOMIC_RELAXED);
+	if (hev_task_system_init () == 0) {
+		HevTaskSystemContext *ctx = hev_task_system_get_context ();
+
+		/* same policy as the calling thread */
+		if (hev_task_system_set_sched_ops (ctx, group->sched_ops) == 0) {
+			hev_task_system_join_group (group, index);
+			error = 0;
+		}
+	}
+
+	/* NOTE: workers post to each other only after all started and before
+	 * all finished, contexts are valid in between */
+	error = hev_task_system_sync_group (group, &group->started, error);
+	if (!error)
+		hev_task_system_schedule (HEV_TASK_RUN_SCHEDULER);
+	hev_task_system_sync_group (group, &group->finished, error);
+	hev_task_system_leave_group ();
+
+	if (hev_task_system_get_context ())
+		hev_task_system_fini ();
+
+	return NULL;
+}
+
+static void
+hev_task_system_drop_inbox (HevTaskSystemContext *ctx)
+{
+	HevTask *wakes;
+
+	/* NOTE: all tasks exited, wakeups hold references only */
+	wakes = __atomic_exchange_n (&ctx->inbox_wakes, NULL, __ATOMIC_ACQUIRE);
+	while (wakes) {
+		HevTask *task = wakes;
+
+		wakes = task->wake_next;
+		__atomic_store_n (&task->wake_pending, 0, __ATOMIC_RELEASE);
+		hev_task_unref (task);
+	}
+}
+#endif
+
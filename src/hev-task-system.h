@@ -10,6 +10,48 @@
 #ifndef __HEV_TASK_SYSTEM_H__
 #define __HEV_TASK_SYSTEM_H__
 
+#include "hev-task.h"
+
+typedef struct _HevTaskSystemStats HevTaskSystemStats;
+typedef enum _HevTaskSystemSchedPolicy HevTaskSystemSchedPolicy;
+
+/**
+ * HevTaskSystemSchedPolicy:
+ * @HEV_TASK_SYSTEM_SCHED_PRIORITY: Strict priority, round-robin within the
+ * same priority. Lower priorities run only when all higher ones wait.
+ * @HEV_TASK_SYSTEM_SCHED_FAIR: Weighted-fair, the ready task that has run
+ * the least virtual time runs next. Higher priorities get more CPU time,
+ * twice every 1/8 of the priority range, and lower ones never starve.
+ *
+ * Since: 1.6
+ */
+enum _HevTaskSystemSchedPolicy
+{
+	HEV_TASK_SYSTEM_SCHED_PRIORITY,
+	HEV_TASK_SYSTEM_SCHED_FAIR,
+};
+
+/**
+ * HevTaskSystemStats:
+ * @task_count: number of tasks in the task system
+ * @ready_task_count: number of tasks ready to run
+ * @switch_count: number of task switches since init
+ * @idle_time: microseconds blocked in I/O poll with no task ready, since init
+ * @deadline_count: number of finished task deadlines, since init
+ * @deadline_miss_count: number of task deadlines finished late, since init
+ *
+ * Since: 1.6
+ */
+struct _HevTaskSystemStats
+{
+	unsigned int task_count;
+	unsigned int ready_task_count;
+	unsigned long switch_count;
+	unsigned long idle_time;
+	unsigned long deadline_count;
+	unsigned long deadline_miss_count;
+};
+
 /**
  * hev_task_system_init:
  *
@@ -24,7 +66,8 @@ int hev_task_system_init (void);
 /**
  * hev_task_system_fini:
  *
- * Finalize the task system.
+ * Finalize the task system. Wakeups posted by other threads and not
+ * handled yet are dropped.
  *
  * Since: 1.0
  */
@@ -39,5 +82,172 @@ void hev_task_system_fini (void);
  */
 void hev_task_system_run (void);
 
+/**
+ * hev_task_system_self:
+ *
+ * Get the task system of current thread.
+ *
+ * Returns: a #HevTaskSystem, or NULL if not initialized in current thread.
+ *
+ * Since: 1.6
+ */
+HevTaskSystem * hev_task_system_self (void);
+
+/**
+ * hev_task_system_run_task:
+ * @self: a #HevTaskSystem
+ * @task (transfer full): a #HevTask
+ * @entry: A #HevTaskEntry
+ * @data (nullable): a user data to passed to @entry
+ *
+ * Run a task in task system @self, as hev_task_run() does in the task system
+ * of current thread. It is safe to call from any thread, including threads
+ * without task system. Tasks from other threads are posted to the inbox of
+ * @self, and picked up in batches by its scheduler. @self must keep running
+ * until the task is picked up. Tasks with a shared stack can only run in
+ * the task system that created them.
+ *
+ * Returns: When successful, returns zero. When an error occurs, returns -1.
+ *
+ * Since: 1.6
+ */
+int hev_task_system_run_task (HevTaskSystem *self, HevTask *task,
+			HevTaskEntry entry, void *data);
+
+/**
+ * hev_task_system_get_stats:
+ * @self: a #HevTaskSystem
+ * @stats: (out): a #HevTaskSystemStats
+ *
+ * Get load statistics of a task system. It is safe to call from any thread,
+ * the values are updated without locking and may be slightly out of date.
+ * The counters wrap around, e.g. the idle time after about 71 minutes on
+ * 32-bit targets. The load of a period can be taken from the unsigned
+ * differences of two samples.
+ *
+ * Since: 1.6
+ */
+void hev_task_system_get_stats (HevTaskSystem *self, HevTaskSystemStats *stats);
+
+/**
+ * hev_task_system_run_workers:
+ * @count: number of worker threads
+ *
+ * Run the task system on @count worker threads, current thread is one of
+ * them. Every worker has its own task system and local running list. When
+ * a worker has no task ready, it asks busy workers for work, and they hand
+ * over up to half of their ready tasks at next scheduling point. The file
+ * descriptors added with hev_task_add_fd() are moved along with a task.
+ *
+ * Tasks that are referenced elsewhere (see hev_task_ref()), sleeping, or
+ * with a shared stack stay on their worker. hev_task_wakeup() may be called
+ * for a task on any worker. Returns when all tasks of workers exited, and
+ * the task systems of workers are finalized, other threads must stop
+ * waking up tasks of them before (see hev_task_wakeup()).
+ *
+ * Returns: When successful, returns zero. When an error occurs, returns -1.
+ *
+ * Since: 1.6
+ */
+int hev_task_system_run_workers (unsigned int count);
+
+/**
+ * hev_task_system_set_sched_policy:
+ * @policy: a #HevTaskSystemSchedPolicy
+ *
+ * Set the scheduling policy of current task system, before any task is
+ * run in it. Workers of hev_task_system_run_workers() use the policy of
+ * the calling thread. The default is %HEV_TASK_SYSTEM_SCHED_PRIORITY.
+ *
+ * Returns: When successful, returns zero. When an error occurs, returns -1.
+ *
+ * Since: 1.6
+ */
+int hev_task_system_set_sched_policy (HevTaskSystemSchedPolicy policy);
+
+/**
+ * hev_task_system_set_time_slice:
+ * @microseconds: time slice of tasks
+ *
+ * Set the time slice of tasks in the task system of current thread, used by
+ * hev_task_yield_if_needed(). The time is measured with the CPU cycle counter
+ * where available. The default is CONFIG_TASK_TIME_SLICE (1ms).
+ *
+ * Since: 1.6
+ */
+void hev_task_system_set_time_slice (unsigned int microseconds);
+
+/**
+ * hev_task_system_set_io_poll_policy:
+ * @interval: maximum number of task switches between I/O polls, or 0
+ * @budget: maximum time between I/O polls in microseconds, or 0
+ *
+ * Set the I/O poll policy of the task system in current thread. While
+ * tasks are ready to run, the scheduler polls I/O events only every
+ * @interval task switches, or once @budget microseconds elapsed since
+ * the last poll, whichever comes first. A zero value disables that limit,
+ * but not both, I/O events and timers would never be handled while tasks
+ * are ready. The elapsed time is measured with a coarse clock, so @budget
+ * is rounded up to the kernel tick. When no task is ready, I/O events are
+ * always polled.
+ *
+ * Returns: When successful, returns zero. When an error occurs, returns -1.
+ *
+ * Since: 1.6
+ */
+int hev_task_system_set_io_poll_policy (unsigned int interval,
+			unsigned int budget);
+
+/**
+ * hev_task_system_set_timer_slack:
+ * @microseconds: default timer slack in microseconds, or 0
+ *
+ * Set the default timer slack of the task system in current thread, used
+ * by hev_task_sleep(), hev_task_usleep() and hev_task_wait_io_timeout().
+ * The granularity is a millisecond, values below it have no effect. See
+ * hev_task_usleep_slack().
+ *
+ * Since: 1.6
+ */
+void hev_task_system_set_timer_slack (unsigned int microseconds);
+
+/**
+ * hev_task_system_set_task_cache_size:
+ * @count: maximum number of cached tasks
+ *
+ * Set the maximum number of exited tasks kept for reuse by the task system
+ * in current thread. Tasks with the default stack size are recycled with
+ * their stack, and handed back by hev_task_new() with -1 stack size.
+ * Excess cached tasks are released immediately. Zero disables the cache.
+ *
+ * Since: 1.6
+ */
+void hev_task_system_set_task_cache_size (unsigned int count);
+
+/**
+ * hev_task_system_trim:
+ *
+ * Release all cached tasks and stacks of the task system in current
+ * thread, e.g. when the thread becomes idle after a burst of tasks.
+ *
+ * Since: 1.6
+ */
+void hev_task_system_trim (void);
+
+/**
+ * hev_task_system_now:
+ *
+ * Get the monotonic time of the task system in current thread, cheaply.
+ * The clock is sampled at most once per scheduler iteration, at the first
+ * call after a task is switched in, and later calls return the same value.
+ * So it's stale by at most the time the current task has run since the
+ * first call, use clock_gettime() across long computations.
+ *
+ * Returns: the time of %CLOCK_MONOTONIC, in microseconds.
+ *
+ * Since: 1.6
+ */
+unsigned long long hev_task_system_now (void);
+
 #endif /* __HEV_TASK_SYSTEM_H__ */
 
@@ -1,42 +1,47 @@
 /*
  ============================================================================
- Name        : hev-task_timer-manager.h
+ Name        : hev-task-timer-manager.c
  Author      : Heiher <r@hev.cc>
  Copyright   : Copyright (c) 2018 everyone.
- Description :
+ Description : Task timer manager
  ============================================================================
  */
 
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/timerfd.h>
+#include <limits.h>
 
 #include "hev-task-timer-manager.h"
-#include "hev-task-private.h"
-#include "hev-task-system-private.h"
+#include "hev-task-clock.h"
 #include "hev-memory-allocator.h"
 
-#define MAX_CACHED_TIMER_COUNT	CONFIG_TASK_TIMER_MAX_COUNT
-
-struct _HevTaskTimer
-{
-	HevTaskTimer *next;
-	HevTaskTimerManager *owner;
-
-	HevTaskSchedEntity sched_entity;
+/*
+ * Hierarchical timing wheel, in ticks of a millisecond. A level has 64
+ * slots, each covers 64 slots of the level below. Level 0 slots are one
+ * tick, expired timers are taken from them; timers of an upper level slot
+ * are cascaded down when the wheel enters its range. 4 levels cover ~4.6
+ * hours, later timers wait in the last slot and are cascaded again.
+ */
+#define LEVEL_BITS	(6)
+#define LEVEL_SIZE	(1 << LEVEL_BITS)
+#define LEVEL_MASK	(LEVEL_SIZE - 1)
+#define LEVEL_COUNT	(4)
 
-	int fd;
-};
+#define MAX_DELTA	((1ULL << (LEVEL_BITS * LEVEL_COUNT)) - 1)
 
 struct _HevTaskTimerManager
 {
-	HevTaskTimer *cached_timers;
+	uint64_t current; /* expired up to */
+	unsigned int count;
 
-	unsigned int cached_count;
-
-	HevTask dummy_task;
+	uint64_t bitmaps[LEVEL_COUNT]; /* non-empty slots */
+	HevTaskTimer *slots[LEVEL_COUNT * LEVEL_SIZE];
 };
 
+static void hev_task_timer_manager_insert (HevTaskTimerManager *self,
+			HevTaskTimer *timer);
+static void hev_task_timer_manager_unlink (HevTaskTimerManager *self,
+			HevTaskTimer *timer);
+static void hev_task_timer_manager_cascade (HevTaskTimerManager *self);
+
 HevTaskTimerManager *
 hev_task_timer_manager_new (void)
 {
@@ -46,109 +51,206 @@ hev_task_timer_manager_new (void)
 	if (!self)
 		return NULL;
 
+	self->current = hev_task_clock_time () / 1000;
+
 	return self;
 }
 
 void
 hev_task_timer_manager_destroy (HevTaskTimerManager *self)
 {
-	HevTaskTimer *iter = self->cached_timers;
+	/* NOTE: timers are embedded in their owners */
+	hev_free (self);
+}
 
-	while (iter) {
-		HevTaskTimer *next = iter->next;
-		close (iter->fd);
-		hev_free (iter);
-		iter = next;
+void
+hev_task_timer_manager_add (HevTaskTimerManager *self, HevTaskTimer *timer,
+			uint64_t expires, unsigned int slack)
+{
+	if (timer->pprev)
+		hev_task_timer_manager_del (self, timer);
+
+	/*
+	 * Round to the most aligned tick in [expires, expires + slack], clear
+	 * the bits below the highest one that differs. Timers with overlapping
+	 * slack are likely rounded to the same tick, and expire together.
+	 */
+	if (slack) {
+		uint64_t limit = expires + slack;
+		uint64_t mask = (~0ULL >> __builtin_clzll (limit ^ expires)) >> 1;
+
+		expires = limit & ~mask;
 	}
 
-	hev_free (self);
+	/* already due, expired by the next tick */
+	if (expires <= self->current)
+		expires = self->current + 1;
+
+	timer->expires = expires;
+	hev_task_timer_manager_insert (self, timer);
+	self->count ++;
 }
 
-HevTaskTimer *
-hev_task_timer_manager_alloc (HevTaskTimerManager *self)
+void
+hev_task_timer_manager_del (HevTaskTimerManager *self, HevTaskTimer *timer)
 {
-	HevTaskTimer *timer;
-	int epoll_fd, fd, flags;
-	struct epoll_event event;
-
-	if (self->cached_timers) {
-		timer = self->cached_timers;
+	if (!timer->pprev)
+		return;
 
-		self->cached_timers = timer->next;
-		self->cached_count --;
+	hev_task_timer_manager_unlink (self, timer);
+	self->count --;
+}
 
-		return timer;
+int
+hev_task_timer_manager_get_timeout (HevTaskTimerManager *self, uint64_t now)
+{
+	uint64_t next = UINT64_MAX;
+	unsigned int level;
+
+	if (!self->count)
+		return -1;
+
+	/*
+	 * First non-empty slot of each level after current one, exact for
+	 * level 0, a cascade for the others, that's early enough.
+	 */
+	for (level=0; level<LEVEL_COUNT; level++) {
+		unsigned int shift = LEVEL_BITS * level;
+		uint64_t bits = self->bitmaps[level];
+		uint64_t block = self->current >> shift;
+		unsigned int pos;
+
+		if (!bits)
+			continue;
+
+		pos = (block + 1) & LEVEL_MASK;
+		bits = (bits >> pos) | (bits << ((LEVEL_SIZE - pos) & LEVEL_MASK));
+		block += 1 + __builtin_ctzll (bits);
+		if ((block << shift) < next)
+			next = block << shift;
 	}
 
-	fd = timerfd_create (CLOCK_MONOTONIC, 0);
-	if (fd == -1)
-		return NULL;
+	if (next <= now)
+		return 0;
+	if ((next - now) > INT_MAX)
+		return INT_MAX;
 
-	if (fcntl (fd, F_SETFL, O_NONBLOCK) == -1) {
-		close (fd);
-		return NULL;
-	}
+	return next - now;
+}
 
-	flags = fcntl (fd, F_GETFD);
-	if (flags == -1) {
-		close (fd);
-		return NULL;
-	}
+HevTaskTimer *
+hev_task_timer_manager_expire (HevTaskTimerManager *self, uint64_t now)
+{
+	HevTaskTimer *list = NULL;
 
-	flags |= FD_CLOEXEC;
-	if (fcntl (fd, F_SETFD, flags) == -1) {
-		close (fd);
-		return NULL;
-	}
-retry:
-	timer = hev_malloc0 (sizeof (HevTaskTimer));
-	if (!timer) {
-		hev_task_yield (HEV_TASK_YIELD);
-		goto retry;
-	}
-	timer->owner = self;
-	timer->sched_entity.task = &self->dummy_task;
-
-	epoll_fd = hev_task_system_get_context ()->epoll_fd;
-	event.events = EPOLLET | EPOLLIN;
-	event.data.ptr = &timer->sched_entity;
-	if (epoll_ctl (epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
-		close (fd);
-		hev_free (timer);
+	if (!self->count) {
+		if (now > self->current)
+			self->current = now;
 		return NULL;
 	}
 
-	timer->fd = fd;
+	while (self->current < now) {
+		uint64_t next = self->current + 1;
+		unsigned int index = next & LEVEL_MASK;
+		HevTaskTimer *timer;
+
+		/* skip empty ticks, to next timer of level 0 or next cascade */
+		if (index) {
+			uint64_t bits = self->bitmaps[0] >> index;
+
+			if (bits)
+				next += __builtin_ctzll (bits);
+			else
+				next = (next | LEVEL_MASK) + 1;
+			if (next > now) {
+				self->current = now;
+				break;
+			}
+		}
+
+		self->current = next;
+		if (!(next & LEVEL_MASK))
+			hev_task_timer_manager_cascade (self);
+
+		index = next & LEVEL_MASK;
+		while ((timer = self->slots[index])) {
+			hev_task_timer_manager_unlink (self, timer);
+			self->count --;
+			timer->next = list;
+			list = timer;
+		}
+	}
 
-	return timer;
+	return list;
 }
 
-void
-hev_task_timer_manager_free (HevTaskTimerManager *self, HevTaskTimer *timer)
+static void
+hev_task_timer_manager_insert (HevTaskTimerManager *self, HevTaskTimer *timer)
 {
-	if (self->cached_count >= MAX_CACHED_TIMER_COUNT) {
-		close (timer->fd);
-		hev_free (timer);
-		return;
+	uint64_t expires = timer->expires;
+	uint64_t delta = expires - self->current;
+	unsigned int level = 0;
+	HevTaskTimer **slot;
+
+	if (delta > MAX_DELTA) {
+		delta = MAX_DELTA;
+		expires = self->current + delta;
 	}
 
-	timer->next = self->cached_timers;
-	self->cached_timers = timer;
-	self->cached_count ++;
+	while (delta >> (LEVEL_BITS * (level + 1)))
+		level ++;
+
+	timer->slot = (level << LEVEL_BITS) |
+		((expires >> (LEVEL_BITS * level)) & LEVEL_MASK);
+	slot = &self->slots[timer->slot];
+
+	timer->next = *slot;
+	if (timer->next)
+		timer->next->pprev = &timer->next;
+	timer->pprev = slot;
+	*slot = timer;
+
+	self->bitmaps[level] |= 1ULL << (timer->slot & LEVEL_MASK);
 }
 
-int
-hev_task_timer_get_fd (HevTaskTimer *timer)
+static void
+hev_task_timer_manager_unlink (HevTaskTimerManager *self, HevTaskTimer *timer)
 {
-	return timer->fd;
+	*timer->pprev = timer->next;
+	if (timer->next)
+		timer->next->pprev = timer->pprev;
+	timer->pprev = NULL;
+
+	if (!self->slots[timer->slot])
+		self->bitmaps[timer->slot >> LEVEL_BITS] &=
+			~(1ULL << (timer->slot & LEVEL_MASK));
 }
 
-void
-hev_task_timer_set_task (HevTaskTimer *timer, HevTask *task)
+static void
+hev_task_timer_manager_cascade (HevTaskTimerManager *self)
 {
-	if (!task)
-		task = &timer->owner->dummy_task;
+	unsigned int level;
 
-	timer->sched_entity.task = task;
+	/* entered the range of a slot of each level that wrapped around */
+	for (level=1; level<LEVEL_COUNT; level++) {
+		unsigned int index;
+		HevTaskTimer *timer;
+
+		index = (self->current >> (LEVEL_BITS * level)) & LEVEL_MASK;
+		timer = self->slots[(level << LEVEL_BITS) | index];
+		self->slots[(level << LEVEL_BITS) | index] = NULL;
+		self->bitmaps[level] &= ~(1ULL << index);
+
+		/* to lower levels, or the same slot of next round */
+		while (timer) {
+			HevTaskTimer *next = timer->next;
+
+			hev_task_timer_manager_insert (self, timer);
+			timer = next;
+		}
+
+		if (index)
+			break;
+	}
 }
 
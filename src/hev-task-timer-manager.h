@@ -3,26 +3,61 @@
  Name        : hev-task-timer-manager.h
  Author      : Heiher <r@hev.cc>
  Copyright   : Copyright (c) 2018 everyone.
- Description :
+ Description : Task timer manager
  ============================================================================
  */
 
 #ifndef __HEV_TASK_TIMER_MANAGER_H__
 #define __HEV_TASK_TIMER_MANAGER_H__
 
+#include <stdint.h>
+
 #include "hev-task.h"
+#include "hev-task-timer.h"
 
-typedef struct _HevTaskTimer HevTaskTimer;
 typedef struct _HevTaskTimerManager HevTaskTimerManager;
 
+/*
+ * A timer in the timing wheel of task system, a sleep of task or a timer
+ * object. Expired ones are unlinked and returned to the scheduler, which
+ * wakes up the task, and rearms the periodic ones.
+ */
+struct _HevTaskTimer
+{
+	HevTaskTimer *next;
+	HevTaskTimer **pprev; /* NULL: not armed */
+
+	uint64_t expires; /* absolute, in milliseconds */
+	unsigned int slot;
+
+	HevTask *task;
+
+	/* absolute, in microseconds, before slack */
+	uint64_t time;
+	unsigned int slack;
+	unsigned int interval; /* 0: one-shot */
+	unsigned int expirations;
+};
+
 HevTaskTimerManager * hev_task_timer_manager_new (void);
 void hev_task_timer_manager_destroy (HevTaskTimerManager *self);
 
-HevTaskTimer * hev_task_timer_manager_alloc (HevTaskTimerManager *self);
-void hev_task_timer_manager_free (HevTaskTimerManager *self, HevTaskTimer *timer);
-
-int hev_task_timer_get_fd (HevTaskTimer *timer);
-void hev_task_timer_set_task (HevTaskTimer *timer, HevTask *task);
+/* may be deferred up to @slack, to expire along with others */
+void hev_task_timer_manager_add (HevTaskTimerManager *self, HevTaskTimer *timer,
+			uint64_t expires, unsigned int slack);
+void hev_task_timer_manager_del (HevTaskTimerManager *self, HevTaskTimer *timer);
+
+/* milliseconds from @now to the next expiry, at most, -1 if no timers */
+int hev_task_timer_manager_get_timeout (HevTaskTimerManager *self, uint64_t now);
+/* unlink the timers expired at @now, in a list linked by next */
+HevTaskTimer * hev_task_timer_manager_expire (HevTaskTimerManager *self,
+			uint64_t now);
+
+static inline int
+hev_task_timer_is_armed (HevTaskTimer *timer)
+{
+	return !!timer->pprev;
+}
 
 #endif /* __HEV_TASK_TIMER_MANAGER_H__ */
 
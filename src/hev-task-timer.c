@@ -0,0 +1,98 @@
+/*
+ ============================================================================
+ Name        : hev-task-timer.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Task timer
+ ============================================================================
+ */
+
+#include "hev-task-timer.h"
+#include "hev-task-private.h"
+#include "hev-task-system-private.h"
+#include "hev-task-clock.h"
+#include "hev-memory-allocator.h"
+
+HevTaskTimer *
+hev_task_timer_new (HevTask *task)
+{
+	HevTaskTimer *self;
+
+	self = hev_malloc0 (sizeof (HevTaskTimer));
+	if (!self)
+		return NULL;
+
+	self->task = hev_task_ref (task);
+
+	return self;
+}
+
+void
+hev_task_timer_destroy (HevTaskTimer *self)
+{
+	hev_task_timer_stop (self);
+	hev_task_unref (self->task);
+	hev_free (self);
+}
+
+int
+hev_task_timer_start (HevTaskTimer *self, unsigned int microseconds,
+			unsigned int interval)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+
+	/* NOTE: armed in timing wheel of owner, task may have been moved */
+	if (!ctx || __atomic_load_n (&self->task->owner, __ATOMIC_ACQUIRE) != ctx)
+		return -1;
+
+	/* NOTE: not the cached clock, it is as old as the task has run */
+	self->interval = interval;
+	hev_task_system_arm_timer (ctx, self,
+				hev_task_clock_time () + microseconds,
+				ctx->timer_slack);
+
+	return 0;
+}
+
+int
+hev_task_timer_stop (HevTaskTimer *self)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+
+	if (!hev_task_timer_is_armed (self))
+		return 0;
+
+	/* pinned while armed, owner is the task system of timing wheel */
+	if (__atomic_load_n (&self->task->owner, __ATOMIC_RELAXED) != ctx)
+		return -1;
+
+	hev_task_system_disarm_timer (ctx, self);
+
+	return 0;
+}
+
+int
+hev_task_timer_is_active (HevTaskTimer *self)
+{
+	return hev_task_timer_is_armed (self);
+}
+
+unsigned int
+hev_task_timer_take_expirations (HevTaskTimer *self)
+{
+	unsigned int expirations = self->expirations;
+
+	self->expirations = 0;
+
+	return expirations;
+}
+
+unsigned int
+hev_task_timer_wait (HevTaskTimer *self)
+{
+	while (!self->expirations && hev_task_timer_is_armed (self))
+		hev_task_yield (HEV_TASK_WAITIO);
+
+	return hev_task_timer_take_expirations (self);
+}
+
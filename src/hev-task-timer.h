@@ -0,0 +1,118 @@
+/*
+ ============================================================================
+ Name        : hev-task-timer.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2018 everyone.
+ Description : Task timer
+ ============================================================================
+ */
+
+#ifndef __HEV_TASK_TIMER_H__
+#define __HEV_TASK_TIMER_H__
+
+#include "hev-task.h"
+
+typedef struct _HevTaskTimer HevTaskTimer;
+
+/**
+ * hev_task_timer_new:
+ * @task: a #HevTask to wake up
+ *
+ * Creates a new stopped timer, which wakes up @task when it expires. The
+ * timer holds a reference to @task. Timers are kept by the task system of
+ * @task, start, stop and destroy them in a task of the same task system,
+ * e.g. @task itself. Other tasks may be moved to another worker at any
+ * scheduling point. @task stays in the task system while the timer is
+ * started, see hev_task_migrate().
+ *
+ * Returns: a new #HevTaskTimer.
+ *
+ * Since: 1.6
+ */
+HevTaskTimer * hev_task_timer_new (HevTask *task);
+
+/**
+ * hev_task_timer_destroy:
+ * @self: a #HevTaskTimer
+ *
+ * Stops and frees a timer. It must be called in the task system of the
+ * task if the timer is started.
+ *
+ * Since: 1.6
+ */
+void hev_task_timer_destroy (HevTaskTimer *self);
+
+/**
+ * hev_task_timer_start:
+ * @self: a #HevTaskTimer
+ * @microseconds: time from now to the first expiration
+ * @interval: time between later expirations, or 0 for one-shot
+ *
+ * Starts a timer, or restarts it if started. Expirations count from the
+ * previous one, not from the wakeup, so a periodic timer doesn't drift;
+ * missed ones are counted at once. The default timer slack of task system
+ * applies, see hev_task_system_set_timer_slack(). Starting and stopping
+ * a timer costs no syscall.
+ *
+ * Returns: When successful, returns zero. When the task of timer is not
+ * owned by the task system of current thread, returns -1.
+ *
+ * Since: 1.6
+ */
+int hev_task_timer_start (HevTaskTimer *self, unsigned int microseconds,
+			unsigned int interval);
+
+/**
+ * hev_task_timer_stop:
+ * @self: a #HevTaskTimer
+ *
+ * Stops a timer, in constant time. Expirations that are not taken yet
+ * are kept.
+ *
+ * Returns: When successful, returns zero. When the timer is started in
+ * another task system, returns -1.
+ *
+ * Since: 1.6
+ */
+int hev_task_timer_stop (HevTaskTimer *self);
+
+/**
+ * hev_task_timer_is_active:
+ * @self: a #HevTaskTimer
+ *
+ * Returns: 1 if the timer is started and will expire, otherwise 0.
+ *
+ * Since: 1.6
+ */
+int hev_task_timer_is_active (HevTaskTimer *self);
+
+/**
+ * hev_task_timer_take_expirations:
+ * @self: a #HevTaskTimer
+ *
+ * Get and reset the number of expirations of a timer, without waiting.
+ * Check it when the task is woken up, e.g. from hev_task_yield() with
+ * %HEV_TASK_WAITIO, to tell the timer from I/O events.
+ *
+ * Returns: the number of expirations since last taken.
+ *
+ * Since: 1.6
+ */
+unsigned int hev_task_timer_take_expirations (HevTaskTimer *self);
+
+/**
+ * hev_task_timer_wait:
+ * @self: a #HevTaskTimer
+ *
+ * Wait in current task until the timer expires, if no expirations are
+ * taken yet. Other wakeups of the task are ignored. Doesn't wait if the
+ * timer is stopped.
+ *
+ * Returns: the number of expirations since last taken, 0 if stopped.
+ *
+ * Since: 1.6
+ */
+unsigned int hev_task_timer_wait (HevTaskTimer *self);
+
+#endif /* __HEV_TASK_TIMER_H__ */
+
@@ -7,55 +7,82 @@
  ============================================================================
  */
 
-#include <assert.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <errno.h>
 #include <unistd.h>
 #include <sys/epoll.h>
-#include <sys/timerfd.h>
 
 #include "hev-task.h"
 #include "hev-task-private.h"
 #include "hev-task-system-private.h"
+#include "hev-task-stack.h"
+#include "hev-task-clock.h"
+#include "hev-task-fd-watcher.h"
 #include "hev-memory-allocator.h"
 
-#define STACK_OVERFLOW_DETECTION_TAG	(0xdeadbeefu)
-
 #define HEV_TASK_STACK_SIZE	(64 * 1024)
 
+#define HEV_TASK_COLORS	(16)
+
 #define ALIGN_DOWN(addr, align) \
 	((addr) & ~((typeof (addr)) align - 1))
 
+static void hev_task_init (HevTask *self, void *stack, void *stack_top,
+			int stack_size);
+static HevTask * hev_task_alloc (void);
+static void hev_task_free (HevTask *self);
+static HevTask * hev_task_new_with_shared_stack (HevTaskSystemContext *ctx);
+static HevTask * hev_task_new_with_free_task (HevTaskSystemContext *ctx);
+static HevTaskFD * hev_task_track_fd (HevTask *self, int fd,
+			unsigned int events);
+static void hev_task_untrack_fd (HevTask *self, HevTaskFD *task_fd);
+static int hev_task_wait_timer (uint64_t expires, unsigned int slack);
+
 HevTask *
 hev_task_new (int stack_size)
 {
+	HevTaskSystemContext *ctx;
 	HevTask *self;
 	uintptr_t stack_addr;
+	void *stack;
+	size_t size;
 
-	self = hev_malloc0 (sizeof (HevTask));
-	if (!self)
-		return NULL;
+	ctx = hev_task_system_get_context ();
 
-	self->ref_count = 1;
-	self->next_priority = HEV_TASK_PRIORITY_LOW;
+	if (stack_size == HEV_TASK_STACK_SHARED)
+		return hev_task_new_with_shared_stack (ctx);
 
-	if (stack_size == -1)
+	if (stack_size == -1) {
+		if (ctx && ctx->free_tasks)
+			return hev_task_new_with_free_task (ctx);
 		stack_size = HEV_TASK_STACK_SIZE;
+	}
 
-	self->stack = hev_malloc0 (stack_size);
-	if (!self->stack) {
-		hev_free (self);
+	size = stack_size;
+	stack = hev_task_stack_pool_alloc (ctx ? ctx->stack_pool : NULL, &size);
+	if (!stack)
+		return NULL;
+
+#ifdef ENABLE_TASK_STACK_COALLOC
+	/* Layout: [stack ... | HevTask], overflow grows away from HevTask */
+	stack_addr = (uintptr_t) (stack + size - sizeof (HevTask));
+	/* cache coloring, avoid placing all tasks in the same cache sets */
+	stack_addr -= (((uintptr_t) stack >> 12) & (HEV_TASK_COLORS - 1)) * HEV_TASK_ALIGN;
+	self = (HevTask *) ALIGN_DOWN (stack_addr, HEV_TASK_ALIGN);
+	stack_addr = (uintptr_t) self;
+	self->mem = NULL;
+#else
+	self = hev_task_alloc ();
+	if (!self) {
+		hev_task_stack_pool_free (ctx ? ctx->stack_pool : NULL, stack, size);
 		return NULL;
 	}
-#ifdef ENABLE_STACK_OVERFLOW_DETECTION
-	*(unsigned int *) self->stack = STACK_OVERFLOW_DETECTION_TAG;
+	stack_addr = (uintptr_t) (stack + size);
 #endif
 
-	stack_addr = (uintptr_t) (self->stack + stack_size);
-	self->stack_top = (void *) ALIGN_DOWN (stack_addr, 16);
-	self->stack_size = stack_size;
-	self->sched_entity.task = self;
+	hev_task_init (self, stack, (void *) ALIGN_DOWN (stack_addr, 16), size);
 
 	return self;
 }
@@ -63,7 +90,8 @@ hev_task_new (int stack_size)
 HevTask *
 hev_task_ref (HevTask *self)
 {
-	self->ref_count ++;
+	/* NOTE: tasks may be released by another worker */
+	__atomic_add_fetch (&self->ref_count, 1, __ATOMIC_RELAXED);
 
 	return self;
 }
@@ -71,15 +99,44 @@ hev_task_ref (HevTask *self)
 void
 hev_task_unref (HevTask *self)
 {
-	self->ref_count --;
-	if (self->ref_count)
+	HevTaskSystemContext *ctx;
+
+	if (__atomic_sub_fetch (&self->ref_count, 1, __ATOMIC_ACQ_REL))
 		return;
 
-#ifdef ENABLE_STACK_OVERFLOW_DETECTION
-	assert (*(unsigned int *) self->stack == STACK_OVERFLOW_DETECTION_TAG);
+	/* recycle default stack tasks, stack and task are kept together */
+	ctx = hev_task_system_get_context ();
+	if (ctx && self->stack && self->stack_size == HEV_TASK_STACK_SIZE &&
+				ctx->free_task_count < ctx->free_task_max) {
+		self->next = ctx->free_tasks;
+		ctx->free_tasks = self;
+		ctx->free_task_count ++;
+		return;
+	}
+
+	hev_task_destroy (self);
+}
+
+void
+hev_task_destroy (HevTask *self)
+{
+	HevTaskSystemContext *ctx;
+
+	hev_task_free_fds (self);
+
+	if (!self->stack) {
+		if (self->saved_stack)
+			hev_free (self->saved_stack);
+		hev_task_free (self);
+		return;
+	}
+
+	ctx = hev_task_system_get_context ();
+	hev_task_stack_pool_free (ctx ? ctx->stack_pool : NULL, self->stack,
+				self->stack_size);
+#ifndef ENABLE_TASK_STACK_COALLOC
+	hev_task_free (self);
 #endif
-	hev_free (self->stack);
-	hev_free (self);
 }
 
 HevTask *
@@ -99,52 +156,163 @@ hev_task_set_priority (HevTask *self, int priority)
 {
 	if (priority < HEV_TASK_PRIORITY_MIN)
 		priority = HEV_TASK_PRIORITY_MIN;
-	else if (priority > HEV_TASK_PRIORITY_MAX)
-		priority = HEV_TASK_PRIORITY_MAX;
+	else if (priority > PRIORITY_MAX)
+		priority = PRIORITY_MAX;
 
 	self->next_priority = priority;
 }
 
+int
+hev_task_get_priority_max (void)
+{
+	return PRIORITY_MAX;
+}
+
 int
 hev_task_get_priority (HevTask *self)
 {
 	return self->next_priority;
 }
 
+int
+hev_task_set_deadline (HevTask *self, unsigned int microseconds)
+{
+	return hev_task_system_set_task_deadline (self, microseconds);
+}
+
 int
 hev_task_add_fd (HevTask *self, int fd, unsigned int events)
 {
-	int epoll_fd;
-	struct epoll_event event;
+	HevTaskSystemContext *ctx;
+	HevTaskFD *task_fd;
 
-	epoll_fd = hev_task_system_get_context ()->epoll_fd;
+	ctx = hev_task_system_get_context ();
+
+	task_fd = hev_task_track_fd (self, fd, events);
+	if (!task_fd)
+		return -1;
 
-	event.events = EPOLLET | events;
-	event.data.ptr = &self->sched_entity;
-	return epoll_ctl (epoll_fd, EPOLL_CTL_ADD, fd, &event);
+	if (hev_task_fd_watcher_add (ctx, task_fd) == -1) {
+		hev_task_untrack_fd (self, task_fd);
+		return -1;
+	}
+
+	return 0;
 }
 
 int
 hev_task_mod_fd (HevTask *self, int fd, unsigned int events)
 {
-	int epoll_fd;
-	struct epoll_event event;
-
-	epoll_fd = hev_task_system_get_context ()->epoll_fd;
-
-	event.events = EPOLLET | events;
-	event.data.ptr = &self->sched_entity;
-	return epoll_ctl (epoll_fd, EPOLL_CTL_MOD, fd, &event);
+	return hev_task_add_fd (self, fd, events);
 }
 
 int
 hev_task_del_fd (HevTask *self, int fd)
 {
-	int epoll_fd;
+	HevTaskSystemContext *ctx;
+	HevTaskFD *task_fd;
+	int res;
+
+	ctx = hev_task_system_get_context ();
+
+	task_fd = hev_task_find_fd (self, fd);
+	if (!task_fd) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	res = hev_task_fd_watcher_remove (ctx, task_fd);
+	hev_task_untrack_fd (self, task_fd);
+
+	return res;
+}
+
+unsigned int
+hev_task_get_fd_ready (HevTask *self, int fd, unsigned int events)
+{
+	HevTaskFD *task_fd;
+
+	/* not in I/O poll, unknown */
+	task_fd = hev_task_find_fd (self, fd);
+	if (!task_fd)
+		return events;
+
+	/* let the syscall report it */
+	if (task_fd->ready & (EPOLLERR | EPOLLHUP))
+		return events;
+
+	return task_fd->ready & events;
+}
+
+void
+hev_task_clear_fd_ready (HevTask *self, int fd, unsigned int events)
+{
+	HevTaskFD *task_fd;
+
+	task_fd = hev_task_find_fd (self, fd);
+	if (task_fd)
+		task_fd->ready &= ~events;
+}
+
+void
+hev_task_attach_fds (HevTask *self, HevTaskSystemContext *ctx)
+{
+	HevTaskFD **prev = &self->fds;
+
+	while (*prev) {
+		HevTaskFD *task_fd = *prev;
+
+		/* an edge is reported at once if fd is ready already */
+		if (hev_task_fd_watcher_add (ctx, task_fd) == -1) {
+			*prev = task_fd->next;
+			hev_free (task_fd);
+			continue;
+		}
+		prev = &task_fd->next;
+	}
+}
+
+void
+hev_task_detach_fds (HevTask *self, HevTaskSystemContext *ctx)
+{
+	HevTaskFD **prev = &self->fds;
+
+	while (*prev) {
+		HevTaskFD *task_fd = *prev;
+
+		/* closed without hev_task_del_fd, removed by kernel */
+		if (hev_task_fd_watcher_remove (ctx, task_fd) == -1) {
+			*prev = task_fd->next;
+			hev_free (task_fd);
+			continue;
+		}
+		prev = &task_fd->next;
+	}
+}
+
+void
+hev_task_free_fds (HevTask *self)
+{
+	while (self->fds) {
+		HevTaskFD *task_fd = self->fds;
+
+		self->fds = task_fd->next;
+		hev_task_fd_watcher_unlink (task_fd);
+		hev_free (task_fd);
+	}
+}
 
-	epoll_fd = hev_task_system_get_context ()->epoll_fd;
+HevTaskFD *
+hev_task_find_fd (HevTask *self, int fd)
+{
+	HevTaskFD *task_fd;
 
-	return epoll_ctl (epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	for (task_fd=self->fds; task_fd; task_fd=task_fd->next) {
+		if (task_fd->fd == fd)
+			return task_fd;
+	}
+
+	return NULL;
 }
 
 void
@@ -159,6 +327,27 @@ hev_task_yield (HevTaskYieldType type)
 	hev_task_system_schedule (type);
 }
 
+int
+hev_task_yield_if_needed (void)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+	uint64_t now = hev_task_clock_cycles ();
+
+	if (!ctx->slice_start) {
+		if (!ctx->time_slice_cycles)
+			ctx->time_slice_cycles = (uint64_t) ctx->time_slice *
+				hev_task_clock_cycles_per_usec ();
+		ctx->slice_start = now;
+		return 0;
+	}
+
+	if ((now - ctx->slice_start) < ctx->time_slice_cycles)
+		return 0;
+
+	hev_task_system_schedule (HEV_TASK_YIELD);
+	return 1;
+}
+
 unsigned int
 hev_task_sleep (unsigned int milliseconds)
 {
@@ -168,55 +357,45 @@ hev_task_sleep (unsigned int milliseconds)
 unsigned int
 hev_task_usleep (unsigned int microseconds)
 {
-	HevTaskSystemContext *ctx;
-	HevTaskTimer *timer;
-	int timer_fd;
-	struct itimerspec spec;
-	ssize_t size;
-	uint64_t time;
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+
+	return hev_task_usleep_slack (microseconds, ctx->timer_slack);
+}
+
+unsigned int
+hev_task_usleep_slack (unsigned int microseconds, unsigned int slack)
+{
+	uint64_t now, end;
 
 	if (microseconds == 0)
 		return 0;
 
-	ctx = hev_task_system_get_context ();
-	timer = hev_task_timer_manager_alloc (ctx->timer_manager);
-	if (!timer)
-		return microseconds;
-
-	timer_fd = hev_task_timer_get_fd (timer);
-	hev_task_timer_set_task (timer, ctx->current_task);
-
-	spec.it_interval.tv_sec = 0;
-	spec.it_interval.tv_nsec = 0;
-	spec.it_value.tv_sec = microseconds / (1000 * 1000);
-	spec.it_value.tv_nsec = (microseconds % (1000 * 1000)) * 1000;
-	if (timerfd_settime (timer_fd, 0, &spec, NULL) == -1)
-		goto quit;
-
-	size = read (timer_fd, &time, sizeof (time));
-	if (size != -1) {
-		microseconds = 0;
-		goto quit;
-	}
+	now = hev_task_clock_time ();
+	end = now + microseconds;
+	if (!hev_task_wait_timer (end, slack))
+		return 0;
 
-	if (errno == EAGAIN)
-		hev_task_yield (HEV_TASK_WAITIO);
+	/* woken up by I/O events, get the number of microseconds left */
+	now = hev_task_clock_time ();
 
-	/* get the number of microseconds left to sleep */
-	if (timerfd_gettime (timer_fd, &spec) == -1)
-		goto quit;
-	if ((spec.it_value.tv_sec + spec.it_value.tv_nsec) == 0) {
-		microseconds = 0;
-		goto quit;
+	return (end > now) ? end - now : 0;
+}
+
+int
+hev_task_wait_io_timeout (int milliseconds)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+
+	if (milliseconds < 0) {
+		hev_task_yield (HEV_TASK_WAITIO);
+		return 1;
 	}
-	microseconds = (spec.it_value.tv_sec * 1000 * 1000) +
-		(spec.it_value.tv_nsec / 1000);
 
-quit:
-	hev_task_timer_set_task (timer, NULL);
-	hev_task_timer_manager_free (ctx->timer_manager, timer);
+	if (milliseconds == 0)
+		return 0;
 
-	return microseconds;
+	return hev_task_wait_timer (hev_task_clock_time () +
+				(uint64_t) milliseconds * 1000, ctx->timer_slack);
 }
 
 void
@@ -233,9 +412,165 @@ hev_task_run (HevTask *self, HevTaskEntry entry, void *data)
 	hev_task_system_run_new_task (self);
 }
 
+int
+hev_task_migrate (HevTask *self, HevTaskSystem *system)
+{
+#ifdef ENABLE_PTHREAD
+	return hev_task_system_migrate_task (self, system);
+#else
+	return -1;
+#endif
+}
+
 void
 hev_task_exit (void)
 {
 	hev_task_system_kill_current_task ();
 }
 
+static void
+hev_task_init (HevTask *self, void *stack, void *stack_top, int stack_size)
+{
+	/* NOTE: keep the allocation of heap and recycled tasks */
+	void *mem = self->mem;
+
+	memset (self, 0, sizeof (HevTask));
+	self->mem = mem;
+
+	self->ref_count = 1;
+	self->next_priority = PRIORITY_MAX;
+
+	self->stack = stack;
+	self->stack_top = stack_top;
+	self->stack_size = stack_size;
+}
+
+static HevTask *
+hev_task_alloc (void)
+{
+	HevTask *self;
+	void *mem;
+
+	/* NOTE: allocators only guarantee malloc alignment */
+	mem = hev_malloc (sizeof (HevTask) + HEV_TASK_ALIGN - 1);
+	if (!mem)
+		return NULL;
+
+	self = (HevTask *) ALIGN_DOWN ((uintptr_t) mem + HEV_TASK_ALIGN - 1,
+				HEV_TASK_ALIGN);
+	self->mem = mem;
+
+	return self;
+}
+
+static void
+hev_task_free (HevTask *self)
+{
+	hev_free (self->mem);
+}
+
+static HevTask *
+hev_task_new_with_shared_stack (HevTaskSystemContext *ctx)
+{
+	HevTask *self;
+	uintptr_t stack_addr;
+
+	/* NOTE: the shared stack belongs to the task system of this thread */
+	if (!ctx)
+		return NULL;
+
+	if (!ctx->shared_stack) {
+		ctx->shared_stack = hev_task_stack_alloc (SHARED_STACK_SIZE);
+		if (!ctx->shared_stack)
+			return NULL;
+	}
+
+	self = hev_task_alloc ();
+	if (!self)
+		return NULL;
+
+	stack_addr = (uintptr_t) (ctx->shared_stack + SHARED_STACK_SIZE);
+	hev_task_init (self, NULL, (void *) ALIGN_DOWN (stack_addr, 16), 0);
+	self->stack_bottom = self->stack_top;
+
+	return self;
+}
+
+static HevTask *
+hev_task_new_with_free_task (HevTaskSystemContext *ctx)
+{
+	HevTask *self;
+
+	self = ctx->free_tasks;
+	ctx->free_tasks = self->next;
+	ctx->free_task_count --;
+
+	/* same as a new one, only the stack is kept */
+	hev_task_free_fds (self);
+	hev_task_init (self, self->stack, self->stack_top, self->stack_size);
+
+	return self;
+}
+
+static HevTaskFD *
+hev_task_track_fd (HevTask *self, int fd, unsigned int events)
+{
+	HevTaskFD *task_fd;
+
+	/* closed and reused fd number, or modified */
+	task_fd = hev_task_find_fd (self, fd);
+	if (!task_fd) {
+		/* linked by fd watcher, must not move */
+		task_fd = hev_malloc (sizeof (HevTaskFD));
+		if (!task_fd)
+			return NULL;
+
+		task_fd->task = self;
+		task_fd->watcher = NULL;
+		task_fd->fd = fd;
+		task_fd->next = self->fds;
+		self->fds = task_fd;
+	}
+
+	/* unknown, ready until a syscall says EAGAIN */
+	task_fd->events = events;
+	task_fd->ready = events;
+	task_fd->polled = 0;
+
+	return task_fd;
+}
+
+static void
+hev_task_untrack_fd (HevTask *self, HevTaskFD *task_fd)
+{
+	HevTaskFD **prev = &self->fds;
+
+	while (*prev != task_fd)
+		prev = &(*prev)->next;
+
+	*prev = task_fd->next;
+	hev_task_fd_watcher_unlink (task_fd);
+	hev_free (task_fd);
+}
+
+static int
+hev_task_wait_timer (uint64_t expires, unsigned int slack)
+{
+	HevTaskSystemContext *ctx = hev_task_system_get_context ();
+	HevTask *task = ctx->current_task;
+
+	/* in timing wheel, no syscall, rounded up to the next millisecond */
+	task->timer.task = task;
+	task->timer.interval = 0;
+	hev_task_system_arm_timer (ctx, &task->timer, expires, slack);
+
+	hev_task_yield (HEV_TASK_WAITIO);
+
+	/* expired */
+	if (!hev_task_timer_is_armed (&task->timer))
+		return 0;
+
+	hev_task_system_disarm_timer (ctx, &task->timer);
+	return 1;
+}
+
@@ -12,13 +12,18 @@
 
 #include <sys/epoll.h>
 
+/* NOTE: the library may be built with fewer priorities, lower ones are
+ * clamped to the lowest it has, see hev_task_get_priority_max() */
 #define HEV_TASK_PRIORITY_MIN	(0)
-#define HEV_TASK_PRIORITY_MAX	(1)
+#define HEV_TASK_PRIORITY_MAX	(31)
 
 #define HEV_TASK_PRIORITY_HIGH	HEV_TASK_PRIORITY_MIN
 #define HEV_TASK_PRIORITY_LOW	HEV_TASK_PRIORITY_MAX
 
+#define HEV_TASK_STACK_SHARED	(-2)
+
 typedef struct _HevTask HevTask;
+typedef struct _HevTaskSystemContext HevTaskSystem;
 typedef enum _HevTaskState HevTaskState;
 typedef enum _HevTaskYieldType HevTaskYieldType;
 typedef void (*HevTaskEntry) (void *data);
@@ -60,7 +65,18 @@ enum _HevTaskYieldType
  * Creates a new task. If @stack_size = -1, the default stack size
  * will be used.
  *
- * Returns: a new #HevTask.
+ * If @stack_size = %HEV_TASK_STACK_SHARED, the task runs on a stack shared
+ * by all such tasks of the task system. When another shared stack task
+ * is switched to, only the used part of the stack is copied out to a
+ * right-sized buffer, and copied back on resume. This trades a memcpy
+ * per switch for a few hundred bytes of memory per idle task. Such tasks
+ * can only be created after hev_task_system_init() in the same thread.
+ * Addresses of their stack variables are only valid while the task is
+ * running, another shared stack task may overwrite them while it is
+ * switched out. Such addresses must not be passed to other tasks or
+ * threads, e.g. a buffer to fill before a hev_task_wakeup().
+ *
+ * Returns: a new #HevTask, or %NULL on failure.
  *
  * Since: 1.0
  */
@@ -117,13 +133,28 @@ HevTaskState hev_task_get_state (HevTask *self);
  * @self: a #HevTask
  * @priority: priority
  *
- * Set the priority of a task. The value range of priority are [0-1],
- * with smaller values representing higher priorities.
+ * Set the priority of a task. The value range of priority are
+ * [HEV_TASK_PRIORITY_MIN-HEV_TASK_PRIORITY_MAX] ([0-31]),
+ * with smaller values representing higher priorities. Priorities lower than
+ * hev_task_get_priority_max() are clamped to it.
  *
  * Since: 1.0
  */
 void hev_task_set_priority (HevTask *self, int priority);
 
+/**
+ * hev_task_get_priority_max:
+ *
+ * Get the lowest priority the library is built with, set by
+ * CONFIG_TASK_PRIORITY_COUNT. It is %HEV_TASK_PRIORITY_MAX by default,
+ * tasks with lower priorities run at this one.
+ *
+ * Returns: the maximum priority value
+ *
+ * Since: 1.6
+ */
+int hev_task_get_priority_max (void);
+
 /**
  * hev_task_get_priority:
  * @self: a #HevTask
@@ -136,6 +167,30 @@ void hev_task_set_priority (HevTask *self, int priority);
  */
 int hev_task_get_priority (HevTask *self);
 
+/**
+ * hev_task_set_deadline:
+ * @self: a #HevTask
+ * @microseconds: time from now to the deadline, or 0 to clear
+ *
+ * Set or clear the deadline of a task, in the task system that owns it.
+ * Ready tasks with a deadline run before all other tasks, regardless of
+ * priority and scheduling policy, the earliest deadline first. Keep it
+ * for short, latency-critical work, they can starve the others.
+ *
+ * A deadline is finished when it's cleared, replaced, or the task exits.
+ * Deadlines finished late are counted as missed in #HevTaskSystemStats.
+ *
+ * It must be called in the task system that owns @self, or before @self
+ * is run. Tasks may be moved to another worker at any scheduling point,
+ * set the deadline of current task for them.
+ *
+ * Returns: When successful, returns zero. When the task is owned by
+ * another task system, returns -1.
+ *
+ * Since: 1.6
+ */
+int hev_task_set_deadline (HevTask *self, unsigned int microseconds);
+
 /**
  * hev_task_add_fd:
  * @self: a #HevTask
@@ -143,7 +198,12 @@ int hev_task_get_priority (HevTask *self);
  * @events: a epoll events. (e.g. EPOLLIN, EPOLLOUT)
  *
  * Add a file descriptor to I/O poll queue of task system. The task system
- * will wake up the task when I/O events ready.
+ * will wake up the task when I/O events ready. The file descriptor is moved
+ * along with the task to another worker, remove it with hev_task_del_fd()
+ * before closing it if the task keeps running.
+ *
+ * A file descriptor can be added to more than one task, e.g. a task reads
+ * and another one writes, each task is woken by the events it added.
  *
  * Returns: When successful, returns zero. When an error occurs, returns -1.
  *
@@ -179,11 +239,48 @@ int hev_task_mod_fd (HevTask *self, int fd, unsigned int events);
  */
 int hev_task_del_fd (HevTask *self, int fd);
 
+/**
+ * hev_task_get_fd_ready:
+ * @self: a #HevTask
+ * @fd: a file descriptor
+ * @events: a epoll events. (e.g. EPOLLIN, EPOLLOUT)
+ *
+ * Get the cached readiness of a file descriptor added to the task. It is
+ * set by the I/O events of task system, and assumed when the file
+ * descriptor is added or modified. Check it before an I/O syscall, and
+ * yield with %HEV_TASK_WAITIO instead if not ready, to skip the syscall
+ * that would fail with EAGAIN.
+ *
+ * Returns: the ready ones of @events, all of @events on error or hang up,
+ * or if @fd is not added to the task.
+ *
+ * Since: 1.6
+ */
+unsigned int hev_task_get_fd_ready (HevTask *self, int fd,
+			unsigned int events);
+
+/**
+ * hev_task_clear_fd_ready:
+ * @self: a #HevTask
+ * @fd: a file descriptor
+ * @events: a epoll events. (e.g. EPOLLIN, EPOLLOUT)
+ *
+ * Clear the cached readiness of a file descriptor added to the task, when
+ * an I/O syscall fails with EAGAIN. It's set again by the next I/O event.
+ *
+ * Since: 1.6
+ */
+void hev_task_clear_fd_ready (HevTask *self, int fd, unsigned int events);
+
 /**
  * hev_task_wakeup:
  * @self: a #HevTask
  *
- * Wake up a task. Don't switch tasks immediately.
+ * Wake up a task. Don't switch tasks immediately. It is safe to call from
+ * any thread, a task of another task system is woken up through its inbox
+ * (the caller must hold a reference to @task). Once the task exited, it's
+ * a no-op until the task is run again. It must not race with
+ * hev_task_system_fini() of the task system that @task is running on.
  *
  * Since: 1.0
  */
@@ -199,6 +296,20 @@ void hev_task_wakeup (HevTask *task);
  */
 void hev_task_yield (HevTaskYieldType type);
 
+/**
+ * hev_task_yield_if_needed:
+ *
+ * Yield only if current task has used up its time slice, see
+ * hev_task_system_set_time_slice(). The slice starts at the first call after
+ * the task is switched in, so check it often. It's cheap enough to call in
+ * inner loops of CPU-bound tasks, to let other tasks run.
+ *
+ * Returns: 1 if yielded, otherwise 0.
+ *
+ * Since: 1.6
+ */
+int hev_task_yield_if_needed (void);
+
 /**
  * hev_task_sleep:
  * @milliseconds: time to sleep
@@ -229,6 +340,44 @@ unsigned int hev_task_sleep (unsigned int milliseconds);
  */
 unsigned int hev_task_usleep (unsigned int microseconds);
 
+/**
+ * hev_task_usleep_slack:
+ * @microseconds: time to sleep
+ * @slack: time the wakeup may be deferred, in microseconds
+ *
+ * Like hev_task_usleep(), but the timer may expire up to @slack
+ * microseconds late. Timers are grouped into one wakeup of the task system
+ * when their slack allows, e.g. idle timeouts of many connections. Timers
+ * have a resolution of a millisecond, the slack is used in whole
+ * milliseconds after the expiry rounded up to it, so slack below a
+ * millisecond has no effect.
+ *
+ * Returns: Zero if the requested time has elapsed, or
+ * the number of microseconds left to sleep.
+ *
+ * Since: 1.6
+ */
+unsigned int hev_task_usleep_slack (unsigned int microseconds,
+			unsigned int slack);
+
+/**
+ * hev_task_wait_io_timeout:
+ * @milliseconds: time to wait, or -1 to wait forever
+ *
+ * Like yield with %HEV_TASK_WAITIO, but gives up after @milliseconds. The
+ * task will be waked up by file descriptors events added to it, by
+ * hev_task_wakeup(), or by the timeout, whichever comes first. It costs no
+ * syscall more than an untimed wait.
+ *
+ * If the events and the timeout come at the same time, the timeout is
+ * reported, the file descriptors may still be ready.
+ *
+ * Returns: Zero if timed out, otherwise 1.
+ *
+ * Since: 1.6
+ */
+int hev_task_wait_io_timeout (int milliseconds);
+
 /**
  * hev_task_run:
  * @self (transfer full): a #HevTask
@@ -242,6 +391,26 @@ unsigned int hev_task_usleep (unsigned int microseconds);
  */
 void hev_task_run (HevTask *self, HevTaskEntry entry, void *data);
 
+/**
+ * hev_task_migrate:
+ * @self: a #HevTask
+ * @system: a #HevTaskSystem
+ *
+ * Move a task of current task system to another one, together with the file
+ * descriptors added by hev_task_add_fd(). The task is moved when it switches
+ * out next time: if @self is the calling task, it yields and resumes in
+ * @system; a task waiting for I/O is woken up; a sleeping task is moved after
+ * the sleep. Both task systems must be workers of the same running
+ * hev_task_system_run_workers(), a task system that is not a worker may
+ * stop running at any time. Workers may still share the task with an idle
+ * worker later.
+ *
+ * Returns: When successful, returns zero. When an error occurs, returns -1.
+ *
+ * Since: 1.6
+ */
+int hev_task_migrate (HevTask *self, HevTaskSystem *system);
+
 /**
  * hev_task_exit:
  *